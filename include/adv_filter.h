@@ -0,0 +1,42 @@
+#ifndef ADV_FILTER_H_
+#define ADV_FILTER_H_
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/net/buf.h>
+
+/*
+ * Scan report filter for SlimeVR trackers. Runs on every advert the
+ * controller reports, so it makes one pass over the AD structures,
+ * compares raw UUID bytes and never formats or allocates anything.
+ */
+
+struct adv_candidate {
+	bt_addr_le_t addr;
+	/* Low 16 bits of the device address, as trackers label themselves */
+	uint16_t tracker_id;
+	int8_t rssi;
+	uint8_t name_len;
+	char name[CONFIG_SLIMEVR_ADV_NAME_LEN + 1];
+	uint32_t seen_ms;
+};
+
+struct adv_filter_stats {
+	uint32_t scanned;
+	uint32_t matched;
+	uint32_t rejected;
+};
+
+/*
+ * Returns the candidate entry for a tracker advert, updated with this
+ * report, or NULL when the advert does not carry the SlimeVR service.
+ * Called from the Bluetooth RX thread only.
+ */
+const struct adv_candidate *adv_filter_match(const struct bt_le_scan_recv_info *info,
+					     struct net_buf_simple *ad);
+
+void adv_filter_get_stats(struct adv_filter_stats *stats);
+
+/* Drops the debug output to INF until raised from the log shell */
+void adv_filter_init(void);
+
+#endif
@@ -7,12 +7,6 @@
 
 
 #define MY_PORT 4242
-#if defined(CONFIG_NET_SOCKETS_SOCKOPT_TLS) || defined(CONFIG_NET_TCP) || \
-	defined(CONFIG_COVERAGE_GCOV)
-#define STACK_SIZE 4096
-#else
-#define STACK_SIZE 2048
-#endif
 
 #if defined(CONFIG_NET_TC_THREAD_COOPERATIVE)
 #define THREAD_PRIORITY K_PRIO_COOP(CONFIG_NUM_COOP_PRIORITIES - 1)
@@ -20,7 +14,6 @@
 #define THREAD_PRIORITY K_PRIO_PREEMPT(8)
 #endif
 
-#define RECV_BUFFER_SIZE 1280
 #define STATS_TIMER 60 /* How often to print statistics (in seconds) */
 
 #if defined(CONFIG_USERSPACE)
@@ -39,28 +32,19 @@ struct data {
 
 	struct {
 		int sock;
-		char recv_buffer[RECV_BUFFER_SIZE];
 		uint32_t counter;
 		atomic_t bytes_received;
 		struct k_work_delayable stats_print;
 	} udp;
-
-	struct {
-		int sock;
-		atomic_t bytes_received;
-		struct k_work_delayable stats_print;
-
-		struct {
-			int sock;
-			char recv_buffer[RECV_BUFFER_SIZE];
-			uint32_t counter;
-		} accepted[1]; //CONFIG_NET_SAMPLE_NUM_HANDLERS
-	} tcp;
 };
 
 struct configs {
+#if defined(CONFIG_NET_IPV4)
 	struct data ipv4;
+#endif
+#if defined(CONFIG_NET_IPV6)
 	struct data ipv6;
+#endif
 };
 
 extern struct configs conf;
@@ -68,9 +52,6 @@ extern struct configs conf;
 void start_udp(void);
 void stop_udp(void);
 
-void start_tcp(void);
-void stop_tcp(void);
-
 void quit(void);
 
 #if defined(CONFIG_NET_VLAN)
@@ -0,0 +1,15 @@
+#ifndef CONN_SCHED_H_
+#define CONN_SCHED_H_
+
+#include "connectionManager.h"
+
+/*
+ * Connection parameter scheduler. Every link gets the same interval,
+ * long enough for all connected links to fit one event each and no
+ * shorter than the sample period of the fastest tracker needs. It is
+ * recomputed whenever a link comes or goes and every
+ * CONFIG_SLIMEVR_CONN_SCHED_PERIOD_MS as the observed rates settle.
+ */
+void conn_sched_start(connection_map *cm);
+
+#endif
@@ -2,34 +2,150 @@
 #define CONNECTION_MANAGER_H_
 
 #include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/gatt.h>
+#include <zephyr/sys/atomic.h>
+
+/* Bring-up stages, several links can be in different stages at once */
+typedef enum {
+    CM_STATE_IDLE,
+    CM_STATE_CONNECTING,
+    CM_STATE_DISCOVERY_QUEUED,
+    CM_STATE_DISCOVERING,
+    CM_STATE_SUBSCRIBING,
+    CM_STATE_STREAMING,
+    CM_STATE_COUNT,
+} cm_state;
 
 typedef struct {
-    char addr[BT_ADDR_LE_STR_LEN];
+    bt_addr_le_t addr;
 	struct bt_conn *connection;
+    cm_state state;
+    /* k_cycle_get_32() when each state was entered */
+    uint32_t state_cycles[CM_STATE_COUNT];
+    struct bt_gatt_exchange_params exchange_params;
+    /* Subscribed with handles from the cache, discovery was skipped */
+    bool handles_cached;
+    /* Connection interval (1.25 ms units) and latency asked for, and
+     * the interval the peripheral accepted */
+    uint16_t interval_req;
+    uint16_t latency_req;
+    uint16_t interval;
     struct bt_gatt_subscribe_params sub_params;
-    struct bt_gatt_write_params write_params;
-    uint64_t debug_counter;
-    uint64_t debug_data_counter;
+    /* Characteristic value handle and properties commands go to */
+    uint16_t write_handle;
+    uint8_t write_props;
+    /* Written by the liveness watchdog only */
+    uint32_t stalls;
+    /* Dropped by the watchdog, reconnect straight to the address */
+    bool stalled;
 } connection_entry;
 
+/*
+ * Everything a notification touches, one small record per slot kept in
+ * its own array so the RX path never pulls in the setup state above.
+ * Written by the BT RX thread only, odd seq while updating. The counters
+ * wrap, readers only ever use differences.
+ */
+typedef struct {
+    /* Copy of entry.connection for the lookup, set by the cm_* calls */
+    struct bt_conn *connection;
+    atomic_t seq;
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t gaps;
+    /* Summed and longest gap, in cycles */
+    uint32_t gap_cycles;
+    uint32_t gap_max_cycles;
+    uint32_t last_rx;
+} connection_rx;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t gaps;
+    uint32_t gap_cycles;
+    uint32_t gap_max_cycles;
+    uint32_t last_rx;
+} connection_counters;
+
 typedef struct {
 	connection_entry *entry;
+    connection_rx *rx;
+    /* bt_conn_index() -> entry index, -1 when unused */
+    int8_t *conn_index;
     int size;
 } connection_map;
 
 #define CONNECTION_MAP_INIT(name, amount) \
     connection_entry name##entry[amount] = {0} ; \
+    connection_rx name##rx[amount] = {0} ; \
+    int8_t name##conn_index[CONFIG_BT_MAX_CONN] = { \
+        [0 ... CONFIG_BT_MAX_CONN - 1] = -1 \
+    }; \
     connection_map name = { \
         .entry = name##entry, \
+        .rx = name##rx, \
+        .conn_index = name##conn_index, \
         .size = amount, \
     };
 
 int cm_get_next_free_object_index(connection_map *cm);
 int cm_remove_object_with_index(connection_map *cm, int index);
-int cm_remove_object_with_addr(connection_map *cm, char addr[BT_ADDR_LE_STR_LEN]);
+int cm_remove_object_with_addr(connection_map *cm, const bt_addr_le_t *addr);
 int cm_add_object(connection_map *cm, connection_entry entry);
-int cm_get_index_with_addr(connection_map *cm, char addr[BT_ADDR_LE_STR_LEN]);
-int cm_get_index_with_conn(connection_map *cm, struct bt_conn *conn);
+int cm_bind_conn(connection_map *cm, int index, struct bt_conn *conn);
+int cm_get_index_with_addr(connection_map *cm, const bt_addr_le_t *addr);
+
+/* Hot path, called for every notification */
+static inline int cm_get_index_with_conn(connection_map *cm, struct bt_conn *conn)
+{
+    int index = cm->conn_index[bt_conn_index(conn)];
+
+    if(index < 0 || cm->rx[index].connection != conn)
+    {
+        return -1;
+    }
+
+    return index;
+}
+
+static inline void cm_set_state(connection_entry *entry, cm_state state)
+{
+    entry->state = state;
+    entry->state_cycles[state] = k_cycle_get_32();
+}
+
+/* Milliseconds between entering two states */
+static inline uint32_t cm_state_ms(connection_entry *entry, cm_state from, cm_state to)
+{
+    return k_cyc_to_ms_floor32(entry->state_cycles[to] - entry->state_cycles[from]);
+}
+
+/* Hot path, counts a notification that arrived at k_cycle_get_32() now */
+static inline void cm_count_rx(connection_map *cm, int index, uint16_t length,
+                               uint32_t now, uint32_t gap_cycles)
+{
+    connection_rx *rx = &cm->rx[index];
+
+    atomic_inc(&rx->seq);
+
+    rx->packets++;
+    rx->bytes += length;
+    if(rx->last_rx != 0 && now - rx->last_rx > gap_cycles)
+    {
+        uint32_t gap = now - rx->last_rx;
+
+        rx->gaps++;
+        rx->gap_cycles += gap;
+        rx->gap_max_cycles = MAX(rx->gap_max_cycles, gap);
+    }
+    rx->last_rx = now;
+
+    atomic_inc(&rx->seq);
+}
+
+/* Consistent copy of the counters from any thread, never blocks the writer */
+void cm_read_counters(connection_map *cm, int index, connection_counters *out);
 
-#endif
\ No newline at end of file
+#endif
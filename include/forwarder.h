@@ -0,0 +1,47 @@
+#ifndef FORWARDER_H_
+#define FORWARDER_H_
+
+#include <zephyr/types.h>
+#include <zephyr/net/socket.h>
+
+struct fwd_stats {
+	uint32_t submitted;
+	uint32_t sent;
+	uint32_t dropped_full;
+	uint32_t dropped_size;
+	uint32_t dropped_no_peer;
+	uint32_t send_errors;
+	uint32_t datagrams;
+	uint32_t datagram_bytes;
+	/* Realtime ring */
+	uint32_t occupancy;
+	uint32_t high_water;
+	/* Bulk ring, bulk_starved counts realtime datagrams cut short for it */
+	uint32_t bulk_sent;
+	uint32_t bulk_dropped_full;
+	uint32_t bulk_occupancy;
+	uint32_t bulk_high_water;
+	uint32_t bulk_starved;
+	/* Frame mode, repeated counts samples sent again in a later frame */
+	uint32_t frames;
+	uint32_t frame_repeated;
+};
+
+/* Called from the notification callback. Copies the payload into the ring
+ * and wakes the sender thread, never blocks. stamp is the k_cycle_get_32()
+ * arrival time the latency histograms are measured from.
+ */
+int fwd_submit(uint8_t tracker, const void *data, uint16_t length,
+	       uint32_t stamp);
+
+void fwd_attach_socket(int sock);
+void fwd_detach_socket(void);
+void fwd_set_peer(const struct sockaddr *addr, socklen_t addrlen);
+void fwd_clear_peer(void);
+
+void fwd_get_stats(struct fwd_stats *stats);
+
+/* Rotation samples replaced in the mailbox before they were sent */
+uint32_t fwd_get_overwrites(uint8_t tracker);
+
+#endif
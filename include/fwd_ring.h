@@ -0,0 +1,87 @@
+#ifndef FWD_RING_H_
+#define FWD_RING_H_
+
+#include <zephyr/types.h>
+#include <zephyr/sys/atomic.h>
+#include <errno.h>
+#include <string.h>
+
+/*
+ * Single-producer/single-consumer ring of notification slots between the
+ * Bluetooth RX thread and the forwarding sender. The slot count is a
+ * power of two, head and tail run freely and wrap at 2^32.
+ */
+
+struct fwd_slot {
+	/* k_cycle_get_32() when the notification arrived */
+	uint32_t stamp;
+	uint8_t tracker;
+	uint8_t len;
+	uint8_t data[CONFIG_SLIMEVR_FWD_SLOT_SIZE];
+};
+
+struct fwd_ring {
+	struct fwd_slot *slot;
+	uint32_t mask;
+	/* head is only written by the producer, tail only by the consumer */
+	atomic_t head;
+	atomic_t tail;
+	/* Consumer only, slots referenced by the unsent datagram */
+	uint32_t held;
+	uint32_t max_held;
+	/* Producer only */
+	uint32_t dropped_full;
+	uint32_t high_water;
+};
+
+static inline int fwd_ring_put(struct fwd_ring *ring, uint8_t tracker,
+			       const void *data, uint16_t length, uint32_t stamp)
+{
+	atomic_val_t head = atomic_get(&ring->head);
+	uint32_t used = head - atomic_get(&ring->tail);
+	struct fwd_slot *slot;
+
+	if (used > ring->mask) {
+		ring->dropped_full++;
+		return -ENOBUFS;
+	}
+
+	slot = &ring->slot[head & ring->mask];
+	slot->len = length;
+	slot->tracker = tracker;
+	slot->stamp = stamp;
+	memcpy(slot->data, data, length);
+
+	/* Publishes the slot, atomic_set is a full barrier */
+	atomic_set(&ring->head, head + 1);
+
+	if (used + 1 > ring->high_water) {
+		ring->high_water = used + 1;
+	}
+
+	return 0;
+}
+
+/* Returns the slot n entries past the tail, NULL if not yet produced */
+static inline struct fwd_slot *fwd_ring_peek(struct fwd_ring *ring, uint32_t n)
+{
+	atomic_val_t tail = atomic_get(&ring->tail);
+
+	if ((uint32_t)(atomic_get(&ring->head) - tail) <= n) {
+		return NULL;
+	}
+
+	return &ring->slot[(tail + n) & ring->mask];
+}
+
+static inline void fwd_ring_release(struct fwd_ring *ring, uint32_t n)
+{
+	atomic_add(&ring->tail, n);
+}
+
+static inline uint32_t fwd_ring_used(struct fwd_ring *ring)
+{
+	return atomic_get(&ring->head) - atomic_get(&ring->tail);
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef GATT_TX_H_
+#define GATT_TX_H_
+
+#include <zephyr/bluetooth/conn.h>
+
+/*
+ * Commands to trackers. Every tracker slot has its own queue of
+ * buffers from one fixed memory slab. Queues are drained from the
+ * system work queue, as bursts of writes without response when the
+ * characteristic allows it, otherwise one write request at a time.
+ */
+
+struct gatt_tx_stats {
+	uint32_t queued;
+	/* Handed to the stack, and confirmed sent or acknowledged */
+	uint32_t sent;
+	uint32_t completed;
+	uint32_t errors;
+	/* Refused because the slab was empty or the queue at its limit */
+	uint32_t no_buffer;
+	uint32_t queue_full;
+	/* Dropped after waiting longer than CONFIG_SLIMEVR_GATT_TX_MAX_AGE_MS */
+	uint32_t expired;
+	uint32_t pending;
+};
+
+/* Opens the queue of a slot once its characteristic is known */
+void gatt_tx_attach(uint8_t tracker, struct bt_conn *conn, uint16_t handle,
+		    bool without_response);
+
+/* Drops whatever is still queued for the slot */
+void gatt_tx_detach(uint8_t tracker);
+
+/*
+ * Copies a command into the queue of a slot, from any thread. Returns
+ * -ENOMEM when no buffer is free, -ENOBUFS when the slot already holds
+ * CONFIG_SLIMEVR_GATT_TX_QUEUE_MAX commands and -ENOTCONN when nothing
+ * is attached to the slot. Never blocks.
+ */
+int gatt_tx_send(uint8_t tracker, const void *data, uint16_t len);
+
+int gatt_tx_get_stats(uint8_t tracker, struct gatt_tx_stats *stats);
+
+#endif
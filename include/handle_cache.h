@@ -0,0 +1,20 @@
+#ifndef HANDLE_CACHE_H_
+#define HANDLE_CACHE_H_
+
+#include <zephyr/bluetooth/addr.h>
+
+/*
+ * Value and CCC handles and properties of the SlimeVR characteristic
+ * per tracker address, so a returning tracker can be subscribed without
+ * discovery.
+ * Kept in RAM and, with CONFIG_SLIMEVR_GATT_CACHE_SETTINGS, in settings,
+ * which a work item writes so callers never wait for flash.
+ */
+
+int handle_cache_get(const bt_addr_le_t *addr, uint16_t *value_handle,
+		     uint16_t *ccc_handle, uint8_t *properties);
+void handle_cache_put(const bt_addr_le_t *addr, uint16_t value_handle,
+		      uint16_t ccc_handle, uint8_t properties);
+void handle_cache_remove(const bt_addr_le_t *addr);
+
+#endif
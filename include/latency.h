@@ -0,0 +1,24 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <zephyr/types.h>
+
+/* Bucket i counts samples that took [2^(i-1), 2^i) us, bucket 0 is < 1 us */
+#define LATENCY_BUCKETS 21
+#define LATENCY_TRACKERS CONFIG_SLIMEVR_MAX_TRACKERS
+
+struct latency_summary {
+	uint32_t count;
+	uint32_t p50_us;
+	uint32_t p99_us;
+	uint32_t max_us;
+};
+
+/* Time from notification to network stack, in k_cycle_get_32() cycles */
+void latency_record(uint8_t tracker, uint32_t cycles);
+
+/* Percentiles are the upper bound of the bucket they fall in */
+int latency_get(uint8_t tracker, struct latency_summary *summary);
+void latency_reset(uint8_t tracker);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef LIVENESS_H_
+#define LIVENESS_H_
+
+#include "connectionManager.h"
+
+/*
+ * Drops streaming links whose tracker has not notified for
+ * CONFIG_SLIMEVR_LIVENESS_TIMEOUT_MS. The entry is marked stalled so the
+ * disconnect handler reconnects straight to its address.
+ */
+void liveness_start(connection_map *cm);
+
+#endif
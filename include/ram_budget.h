@@ -0,0 +1,51 @@
+#ifndef RAM_BUDGET_H_
+#define RAM_BUDGET_H_
+
+#include <zephyr/devicetree.h>
+#include <zephyr/sys/iterable_sections.h>
+#include <zephyr/toolchain.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Static RAM a module holds per tracker slot and regardless of the
+ * tracker count. Every module with per-tracker state registers its
+ * share with RAM_BUDGET_DEFINE, ram_budget_report() logs them with
+ * their sum for CONFIG_SLIMEVR_MAX_TRACKERS. Bluetooth host and
+ * controller link memory is not in the table, it shows in the static
+ * RAM total.
+ *
+ * Each registration also puts one byte per budgeted byte into the
+ * never loaded .ram_budget_sum section. ram_budget.ld fails the link
+ * when its size, the sum of every budget, exceeds RAM less
+ * CONFIG_SLIMEVR_RAM_RESERVE.
+ */
+
+struct ram_budget {
+	const char *name;
+	size_t per_tracker;
+	size_t shared;
+};
+
+#if DT_HAS_CHOSEN(zephyr_sram)
+#define RAM_BUDGET_SRAM DT_REG_SIZE(DT_CHOSEN(zephyr_sram))
+#else
+#define RAM_BUDGET_SRAM SIZE_MAX
+#endif
+
+#define RAM_BUDGET_BYTES(_per_tracker, _shared)                              \
+	((_per_tracker) * CONFIG_SLIMEVR_MAX_TRACKERS + (_shared))
+
+#define RAM_BUDGET_DEFINE(_name, _per_tracker, _shared)                      \
+	static const uint8_t _name##_ram_budget_sum                           \
+		[RAM_BUDGET_BYTES(_per_tracker, _shared)]                     \
+		Z_GENERIC_SECTION(.ram_budget_sum) __used;                    \
+	static const STRUCT_SECTION_ITERABLE(ram_budget, _name##_ram_budget) = { \
+		.name = #_name,                                               \
+		.per_tracker = (_per_tracker),                                \
+		.shared = (_shared),                                          \
+	}
+
+void ram_budget_report(void);
+
+#endif
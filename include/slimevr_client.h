@@ -0,0 +1,30 @@
+#ifndef SLIMEVR_CLIENT_H_
+#define SLIMEVR_CLIENT_H_
+
+#include <zephyr/types.h>
+#include <zephyr/net/socket.h>
+
+/* Server packets routed to trackers */
+struct svr_client_stats {
+	uint32_t downlink;
+	/* Tracker queue entries, a packet for all sensors makes several */
+	uint32_t queued;
+	uint32_t unknown_tracker;
+	uint32_t overflow;
+};
+
+void svr_client_attach_socket(int sock);
+void svr_client_detach_socket(void);
+
+/* Called by the UDP loop for every datagram received */
+void svr_client_recv(int sock, const uint8_t *buf, size_t len,
+		     const struct sockaddr *from, socklen_t fromlen);
+
+/* Announces or retires the sensor of a tracker slot */
+void svr_client_tracker_online(uint8_t tracker, bool online);
+
+bool svr_client_is_connected(void);
+
+void svr_client_get_stats(struct svr_client_stats *stats);
+
+#endif
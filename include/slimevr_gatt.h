@@ -0,0 +1,12 @@
+#ifndef SLIMEVR_GATT_H_
+#define SLIMEVR_GATT_H_
+
+#include <zephyr/bluetooth/uuid.h>
+
+/* SlimeVR tracker service and its notify/write characteristic */
+#define UUID_SLIME_VR_VAL BT_UUID_128_ENCODE(0x677abafc, 0x4bd7, 0xcfa8, 0x014e, 0xbb1444f02608)
+#define UUID_SLIME_VR BT_UUID_DECLARE_128(UUID_SLIME_VR_VAL)
+#define UUID_SLIME_VR_CHR_VAL BT_UUID_128_ENCODE(0x6fd1aa9d, 0xd1da, 0xca9f, 0x144b, 0x8118aaae7c9d)
+#define UUID_SLIME_VR_CHR BT_UUID_DECLARE_128(UUID_SLIME_VR_CHR_VAL)
+
+#endif
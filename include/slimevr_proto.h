@@ -0,0 +1,113 @@
+#ifndef SLIMEVR_PROTO_H_
+#define SLIMEVR_PROTO_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+
+/*
+ * SlimeVR server UDP protocol, tracker side.
+ *
+ * Every packet is [u32 type][u64 packet number][body], big endian. A
+ * bundle packet carries several packets as [u16 length][u32 type][body]
+ * records behind a single header.
+ *
+ * The receiver shows up at the server as one device and every tracker
+ * as one of its sensors, sensor id = connection slot. Trackers notify
+ * the same packets over GATT, the receiver only renumbers them and
+ * rewrites the sensor id.
+ */
+
+#define SVR_PACKET_HEARTBEAT 0
+#define SVR_PACKET_HANDSHAKE 3
+#define SVR_PACKET_ACCEL 4
+#define SVR_PACKET_PING_PONG 10
+#define SVR_PACKET_BATTERY_LEVEL 12
+#define SVR_PACKET_SENSOR_INFO 15
+#define SVR_PACKET_ROTATION_DATA 17
+#define SVR_PACKET_FEATURE_FLAGS 22
+#define SVR_PACKET_SET_CONFIG_FLAG 25
+#define SVR_PACKET_BUNDLE 100
+/*
+ * Receiver extension, not an upstream packet type: sample age of every
+ * sensor in a frame bundle. Servers that do not know it skip the record
+ * by its length.
+ */
+#define SVR_PACKET_FRAME_AGES 200
+/*
+ * Receiver extension between receiver and tracker only: a request is
+ * [u8 seq][u32 receiver us], the tracker notifies it back with its own
+ * clock appended as [u8 seq][u32 receiver us][u32 tracker us].
+ */
+#define SVR_PACKET_TIME_SYNC 201
+
+/* Server to tracker */
+#define SVR_PACKET_RECEIVE_HEARTBEAT 1
+#define SVR_PACKET_RECEIVE_VIBRATE 2
+#define SVR_PACKET_RECEIVE_HANDSHAKE 3
+#define SVR_PACKET_RECEIVE_COMMAND 4
+
+#define SVR_SENSOR_OFFLINE 0
+#define SVR_SENSOR_OK 1
+
+/* Sensor id of server packets meant for every sensor */
+#define SVR_SENSOR_ALL 255
+
+#define SVR_ROTATION_DATA_NORMAL 1
+
+#define SVR_HEADER_LEN 12
+#define SVR_TYPE_LEN 4
+#define SVR_RECORD_HDR_LEN 2
+
+#define SVR_HEARTBEAT_LEN SVR_HEADER_LEN
+#define SVR_SENSOR_INFO_LEN (SVR_HEADER_LEN + 3)
+#define SVR_ROTATION_LEN (SVR_HEADER_LEN + 19)
+#define SVR_ACCEL_LEN (SVR_HEADER_LEN + 13)
+#define SVR_BATTERY_LEN (SVR_HEADER_LEN + 8)
+#define SVR_HANDSHAKE_MAX_LEN 64
+#define SVR_TIME_SYNC_LEN (SVR_HEADER_LEN + 5)
+#define SVR_TIME_SYNC_REPLY_LEN (SVR_HEADER_LEN + 9)
+/* Rotation followed by a u32 capture time in microseconds */
+#define SVR_CAPTURE_TIME_LEN 4
+#define SVR_ROTATION_TIMED_LEN (SVR_ROTATION_LEN + SVR_CAPTURE_TIME_LEN)
+#define SVR_FRAME_AGE_LEN 3
+#define SVR_FRAME_AGES_LEN(count) \
+	(SVR_RECORD_HDR_LEN + SVR_TYPE_LEN + 1 + (count) * SVR_FRAME_AGE_LEN)
+
+/* Reply the server sends to a handshake, without trailing version digit */
+#define SVR_HANDSHAKE_REPLY "Hey OVR =D"
+
+size_t svr_encode_header(uint8_t *buf, uint32_t type);
+size_t svr_encode_handshake(uint8_t *buf, const uint8_t mac[6]);
+size_t svr_encode_heartbeat(uint8_t *buf);
+size_t svr_encode_sensor_info(uint8_t *buf, uint8_t sensor_id, uint8_t state);
+size_t svr_encode_rotation(uint8_t *buf, uint8_t sensor_id,
+			   const float quat[4], uint8_t accuracy);
+size_t svr_encode_accel(uint8_t *buf, uint8_t sensor_id, const float accel[3]);
+size_t svr_encode_battery(uint8_t *buf, float voltage, float level);
+size_t svr_encode_time_sync(uint8_t *buf, uint8_t seq, uint32_t receiver_us);
+
+/*
+ * Turns a tracker packet into a bundle record in place: drops the packet
+ * number, prepends the record length and rewrites the sensor id.
+ * Returns the record length and its start in *record, or a negative
+ * error for packets too short to carry a header.
+ */
+int svr_bundle_record(uint8_t sensor_id, uint8_t *pkt, size_t len,
+		      uint8_t **record);
+
+/*
+ * Bundle record listing [u8 sensor id][u16 age in us] for count sensors,
+ * ages saturate at 65535 us.
+ */
+size_t svr_encode_frame_ages(uint8_t *buf, const uint8_t *sensor_id,
+			     const uint32_t *age_us, size_t count);
+
+/*
+ * Sensor a server packet is addressed to, SVR_SENSOR_ALL for packets
+ * meant for the whole device, or -ENOTSUP for packets the receiver
+ * handles itself. A packet for one sensor is rewritten in place to
+ * sensor 0, the only sensor of a tracker.
+ */
+int svr_downlink_sensor(uint8_t *pkt, size_t len);
+
+#endif
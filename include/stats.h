@@ -0,0 +1,34 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/types.h>
+
+#include "connectionManager.h"
+
+#define STATS_TRACKERS CONFIG_SLIMEVR_MAX_TRACKERS
+
+struct tracker_rates {
+	uint32_t packets_per_sec;
+	uint32_t bytes_per_sec;
+	/* Gaps longer than CONFIG_SLIMEVR_STATS_GAP_MS in the last interval */
+	uint32_t gaps;
+	/* Mean gap length in the last interval, longest gap ever */
+	uint32_t gap_ms;
+	uint32_t gap_max_ms;
+	/* Links the liveness watchdog dropped */
+	uint32_t stalls;
+	bool active;
+};
+
+void stats_start(connection_map *cm);
+
+/* Rates of the last completed interval, never touches the hot path */
+int stats_get_tracker(uint8_t tracker, struct tracker_rates *rates);
+
+static inline uint32_t stats_gap_cycles(void)
+{
+	return k_ms_to_cyc_ceil32(CONFIG_SLIMEVR_STATS_GAP_MS);
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef TIME_SYNC_H_
+#define TIME_SYNC_H_
+
+#include <zephyr/types.h>
+
+#include "connectionManager.h"
+
+/*
+ * Tracker to receiver clock mapping. Every streaming tracker is
+ * periodically sent an SVR_PACKET_TIME_SYNC request over its GATT queue
+ * and notifies it back with its own clock, which gives the offset of
+ * its clock and, over several rounds, its drift.
+ *
+ * Rotations forwarded with sync enabled end in a u32 capture time in
+ * receiver microseconds. Trackers that stamp their rotations get them
+ * converted, for the others the arrival time is used.
+ */
+
+struct time_sync_info {
+	bool synced;
+	/* Tracker clock minus receiver clock, at the last update */
+	int32_t offset_us;
+	int32_t drift_ppb;
+	/* Round trip of the exchange the offset came from */
+	uint32_t rtt_us;
+	uint32_t exchanges;
+	uint32_t rejected;
+};
+
+void time_sync_start(connection_map *cm);
+
+/* Forgets the clock of a slot whose tracker went away */
+void time_sync_reset(uint8_t tracker);
+
+/*
+ * Called on the RX path for every notification. Returns true for a
+ * sync reply, which is consumed and must not be forwarded.
+ */
+bool time_sync_handle(uint8_t tracker, const uint8_t *data, uint16_t length);
+
+/*
+ * Copies a rotation packet into buf, at least SVR_ROTATION_TIMED_LEN
+ * bytes, ending in its capture time on the receiver clock. Returns the
+ * new length, or 0 for packets that are not rotations.
+ */
+uint16_t time_sync_stamp(uint8_t tracker, const uint8_t *data,
+			 uint16_t length, uint8_t *buf);
+
+int time_sync_get(uint8_t tracker, struct time_sync_info *info);
+
+#endif
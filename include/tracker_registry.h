@@ -0,0 +1,19 @@
+#ifndef TRACKER_REGISTRY_H_
+#define TRACKER_REGISTRY_H_
+
+#include <zephyr/bluetooth/addr.h>
+
+/*
+ * Addresses of every tracker that has streamed to this receiver, kept
+ * in settings so they can be auto-connected from the controller accept
+ * list right after boot.
+ */
+
+/* Updates the RAM copy, the settings are written from a work item */
+int registry_add(const bt_addr_le_t *addr);
+int registry_count(void);
+
+/* Copies up to max known addresses, returns how many */
+int registry_get_all(bt_addr_le_t *out, int max);
+
+#endif
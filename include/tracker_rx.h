@@ -0,0 +1,17 @@
+#ifndef TRACKER_RX_H_
+#define TRACKER_RX_H_
+
+#include <zephyr/types.h>
+
+#include "connectionManager.h"
+
+/*
+ * Data path of every tracker notification: counts it in its entry,
+ * hands time sync replies to the estimator and queues the rest for
+ * forwarding. now is the k_cycle_get_32() arrival time. Runs on the
+ * thread that received the notification and never blocks.
+ */
+void tracker_rx(connection_map *cm, int index, const void *data,
+		uint16_t length, uint32_t now);
+
+#endif
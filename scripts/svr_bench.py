@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Minimal SlimeVR server that measures what the receiver forwards.
+
+Answers the receiver's handshake, keeps the session alive with
+heartbeats and unpacks every bundle. Rotation records that end in the
+[u32 sequence][u32 generation time in us] marker of the synthetic
+trackers are counted per sensor, which gives samples/s, losses and the
+delay of each sample. The receiver clock is not the host clock, so the
+delay is reported above the smallest one seen per sensor.
+
+    python3 scripts/svr_bench.py [--port 6969] [--interval 1]
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+PACKET_HEARTBEAT = 0
+PACKET_HANDSHAKE = 3
+PACKET_ROTATION_DATA = 17
+PACKET_BUNDLE = 100
+RECEIVE_HEARTBEAT = 1
+
+HEADER = struct.Struct(">IQ")
+RECORD = struct.Struct(">HI")
+ROTATION_BODY_LEN = 19
+MARKER = struct.Struct(">II")
+
+
+class Sensor:
+    def __init__(self):
+        self.first_seq = None
+        self.last_seq = None
+        self.received = 0
+        self.interval_received = 0
+        self.min_delay = None
+        self.delays = []
+
+    def add(self, seq, delay_us):
+        if self.first_seq is None:
+            self.first_seq = seq
+        self.last_seq = seq if self.last_seq is None else max(self.last_seq, seq)
+        self.received += 1
+        self.interval_received += 1
+        if self.min_delay is None or delay_us < self.min_delay:
+            self.min_delay = delay_us
+        self.delays.append(delay_us)
+
+    def lost(self):
+        if self.first_seq is None:
+            return 0
+        return self.last_seq - self.first_seq + 1 - self.received
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=6969)
+    parser.add_argument("--interval", type=float, default=1.0)
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", args.port))
+    sock.settimeout(0.1)
+
+    peer = None
+    packet_number = 0
+    sensors = {}
+    datagrams = 0
+    samples = 0
+    last_report = time.monotonic()
+    last_heartbeat = 0.0
+
+    print(f"Listening on UDP port {args.port}")
+
+    while True:
+        now = time.monotonic()
+
+        if peer is not None and now - last_heartbeat >= 0.5:
+            packet_number += 1
+            sock.sendto(HEADER.pack(RECEIVE_HEARTBEAT, packet_number), peer)
+            last_heartbeat = now
+
+        if now - last_report >= args.interval:
+            elapsed = now - last_report
+            print(f"{datagrams / elapsed:.0f} datagrams/s, "
+                  f"{samples / elapsed:.0f} samples/s")
+            for sensor_id, s in sorted(sensors.items()):
+                relative = [d - s.min_delay for d in s.delays]
+                print(f"  sensor {sensor_id}: "
+                      f"{s.interval_received / elapsed:.0f}/s, "
+                      f"{s.lost()} lost of {s.received + s.lost()}, "
+                      f"delay above min p50 {percentile(relative, 50)} us "
+                      f"p99 {percentile(relative, 99)} us")
+                s.interval_received = 0
+                s.delays = []
+            datagrams = 0
+            samples = 0
+            last_report = now
+
+        try:
+            data, addr = sock.recvfrom(2048)
+        except socket.timeout:
+            continue
+
+        arrival_us = int(time.monotonic() * 1e6)
+
+        if len(data) < HEADER.size:
+            continue
+
+        packet_type, _ = HEADER.unpack_from(data)
+
+        if packet_type == PACKET_HANDSHAKE:
+            if peer != addr:
+                print(f"Receiver at {addr[0]}:{addr[1]}")
+            peer = addr
+            sock.sendto(bytes([PACKET_HANDSHAKE]) + b"Hey OVR =D 5", addr)
+            continue
+
+        if packet_type != PACKET_BUNDLE:
+            continue
+
+        datagrams += 1
+        offset = HEADER.size
+
+        while offset + RECORD.size <= len(data):
+            length, record_type = RECORD.unpack_from(data, offset)
+            body = data[offset + RECORD.size:offset + 2 + length]
+            offset += 2 + length
+
+            if record_type != PACKET_ROTATION_DATA:
+                continue
+
+            samples += 1
+
+            if len(body) < ROTATION_BODY_LEN + MARKER.size:
+                continue
+
+            seq, sent_us = MARKER.unpack_from(body, ROTATION_BODY_LEN)
+            sensor = sensors.setdefault(body[0], Sensor())
+            sensor.add(seq, arrival_us - sent_us)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,158 @@
+/* adv_filter.c - Single pass SlimeVR advert filter */
+
+/*
+ * Debug output is compiled in but filtered at runtime, enable it from
+ * the shell with "log enable dbg adv_filter".
+ */
+
+#include <zephyr/logging/log.h>
+#include <zephyr/logging/log_ctrl.h>
+LOG_MODULE_REGISTER(adv_filter, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+#include "adv_filter.h"
+#include "slimevr_gatt.h"
+
+/* Same byte order as the service UUID travels in over the air */
+static const uint8_t slime_vr_uuid[BT_UUID_SIZE_128] = {
+	UUID_SLIME_VR_VAL
+};
+
+static struct adv_candidate candidates[CONFIG_SLIMEVR_ADV_CANDIDATES];
+
+static atomic_t scanned;
+static atomic_t matched;
+
+static bool has_uuid(const uint8_t *data, uint8_t len)
+{
+	for (; len >= BT_UUID_SIZE_128; data += BT_UUID_SIZE_128,
+	     len -= BT_UUID_SIZE_128) {
+		if (memcmp(data, slime_vr_uuid, BT_UUID_SIZE_128) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static struct adv_candidate *candidate_find(const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < ARRAY_SIZE(candidates); i++) {
+		if (bt_addr_le_eq(addr, &candidates[i].addr)) {
+			return &candidates[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* The entry of this address, or else the one seen longest ago */
+static struct adv_candidate *candidate_slot(const bt_addr_le_t *addr)
+{
+	struct adv_candidate *oldest = &candidates[0];
+	struct adv_candidate *c = candidate_find(addr);
+
+	if (c != NULL) {
+		return c;
+	}
+
+	for (int i = 1; i < ARRAY_SIZE(candidates); i++) {
+		if ((int32_t)(candidates[i].seen_ms - oldest->seen_ms) < 0) {
+			oldest = &candidates[i];
+		}
+	}
+
+	bt_addr_le_copy(&oldest->addr, addr);
+	oldest->tracker_id = sys_get_le16(addr->a.val);
+	oldest->name_len = 0;
+	oldest->name[0] = '\0';
+
+	return oldest;
+}
+
+static void candidate_name(struct adv_candidate *c, const uint8_t *name,
+			   uint8_t len)
+{
+	c->name_len = MIN(len, sizeof(c->name) - 1);
+	memcpy(c->name, name, c->name_len);
+	c->name[c->name_len] = '\0';
+}
+
+const struct adv_candidate *adv_filter_match(const struct bt_le_scan_recv_info *info,
+					     struct net_buf_simple *ad)
+{
+	const uint8_t *p = ad->data;
+	const uint8_t *end = ad->data + ad->len;
+	const uint8_t *name = NULL;
+	uint8_t name_len = 0;
+	bool found = false;
+	struct adv_candidate *c;
+
+	atomic_inc(&scanned);
+
+	/* [len][type][data], len covers type and data */
+	while (end - p >= 2 && p[0] != 0 && p[0] < end - p) {
+		uint8_t len = p[0] - 1;
+		uint8_t type = p[1];
+		const uint8_t *data = p + 2;
+
+		switch (type) {
+		case BT_DATA_UUID128_ALL:
+		case BT_DATA_UUID128_SOME:
+			found = found || has_uuid(data, len);
+			break;
+		case BT_DATA_NAME_COMPLETE:
+		case BT_DATA_NAME_SHORTENED:
+			name = data;
+			name_len = len;
+			break;
+		default:
+			break;
+		}
+
+		p = data + len;
+	}
+
+	if (!found) {
+		/* The name usually comes in the scan response, without the UUID */
+		if (name != NULL && (c = candidate_find(info->addr)) != NULL) {
+			candidate_name(c, name, name_len);
+		}
+
+		return NULL;
+	}
+
+	atomic_inc(&matched);
+
+	c = candidate_slot(info->addr);
+	c->rssi = info->rssi;
+	c->seen_ms = k_uptime_get_32();
+
+	if (name != NULL) {
+		candidate_name(c, name, name_len);
+	}
+
+	LOG_DBG("Tracker %04x RSSI %d name %s", c->tracker_id, c->rssi, c->name);
+
+	return c;
+}
+
+void adv_filter_get_stats(struct adv_filter_stats *stats)
+{
+	stats->scanned = atomic_get(&scanned);
+	stats->matched = atomic_get(&matched);
+	stats->rejected = stats->scanned - stats->matched;
+}
+
+void adv_filter_init(void)
+{
+	/* Quiet by default, called once the log backends are up */
+	if (IS_ENABLED(CONFIG_LOG_RUNTIME_FILTERING)) {
+		log_filter_set(NULL, Z_LOG_LOCAL_DOMAIN_ID, LOG_CURRENT_MODULE_ID(),
+			       LOG_LEVEL_INF);
+	}
+}
@@ -0,0 +1,209 @@
+/* bench.c - Hot path microbenchmarks as a shell command */
+
+/*
+ * "bench [iterations]" times the per-notification and per-connection
+ * primitives with the timing API, which counts CPU cycles where the
+ * core has a cycle counter. Every result is one CSV line:
+ *
+ *   bench,<name>,<slots>,<iterations>,<total cycles>,<cycles/call>,<ns/call>
+ *
+ * Lookups run on a private map filled to 6, 11 and 20 slots with their
+ * worst case, the entry searched for in the last slot or absent. Only
+ * cm_get_index_with_conn() needs a real bt_conn and uses the first live
+ * link of the receiver, it is skipped while no tracker is connected.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/timing/timing.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "connectionManager.h"
+#include "fwd_ring.h"
+#include "slimevr_proto.h"
+#include "stats.h"
+
+#define BENCH_SLOTS_MAX 20
+#define BENCH_ITERATIONS 10000
+
+/* The receiver's own map, defined by main.c or synthetic.c */
+extern connection_map connections;
+
+CONNECTION_MAP_INIT(bench_map, BENCH_SLOTS_MAX)
+
+static const int bench_slots[] = {6, 11, BENCH_SLOTS_MAX};
+
+static volatile int sink;
+
+static struct fwd_slot bench_slots[8];
+static struct fwd_ring bench_ring = {
+	.slot = bench_slots,
+	.mask = ARRAY_SIZE(bench_slots) - 1,
+};
+
+static void bench_print(const struct shell *sh, const char *name, int slots,
+			uint32_t iterations, uint64_t cycles)
+{
+	shell_print(sh, "bench,%s,%d,%u,%llu,%llu,%llu", name, slots, iterations,
+		    (unsigned long long)cycles,
+		    (unsigned long long)(cycles / iterations),
+		    (unsigned long long)(timing_cycles_to_ns(cycles) / iterations));
+}
+
+/* Every slot in use, only the addresses differ */
+static void bench_fill(int slots)
+{
+	bench_map.size = slots;
+
+	for (int i = 0; i < slots; i++) {
+		connection_entry *entry = &bench_map.entry[i];
+
+		/* Lookups compare the pointer, it is never dereferenced */
+		entry->connection = (struct bt_conn *)&bench_map;
+		entry->addr.type = BT_ADDR_LE_RANDOM;
+		entry->addr.a.val[0] = i;
+		entry->addr.a.val[5] = 0xc0;
+	}
+}
+
+static void bench_lookups(const struct shell *sh, uint32_t iterations)
+{
+	for (int s = 0; s < ARRAY_SIZE(bench_slots); s++) {
+		int slots = bench_slots[s];
+		bt_addr_le_t last, missing;
+		timing_t start, end;
+
+		bench_fill(slots);
+		bt_addr_le_copy(&last, &bench_map.entry[slots - 1].addr);
+		bt_addr_le_copy(&missing, &last);
+		missing.a.val[0] = 0xff;
+
+		start = timing_counter_get();
+		for (uint32_t i = 0; i < iterations; i++) {
+			sink = cm_get_index_with_addr(&bench_map, &last);
+		}
+		end = timing_counter_get();
+		bench_print(sh, "cm_get_index_with_addr_last", slots, iterations,
+			    timing_cycles_get(&start, &end));
+
+		start = timing_counter_get();
+		for (uint32_t i = 0; i < iterations; i++) {
+			sink = cm_get_index_with_addr(&bench_map, &missing);
+		}
+		end = timing_counter_get();
+		bench_print(sh, "cm_get_index_with_addr_miss", slots, iterations,
+			    timing_cycles_get(&start, &end));
+
+		start = timing_counter_get();
+		for (uint32_t i = 0; i < iterations; i++) {
+			sink = cm_get_next_free_object_index(&bench_map);
+		}
+		end = timing_counter_get();
+		bench_print(sh, "cm_get_next_free_object_index_full", slots,
+			    iterations, timing_cycles_get(&start, &end));
+	}
+}
+
+static void bench_live(const struct shell *sh, uint32_t iterations)
+{
+	struct bt_conn *conn = NULL;
+	timing_t start, end;
+
+	for (int i = 0; i < connections.size; i++) {
+		if (connections.entry[i].connection != NULL) {
+			conn = connections.entry[i].connection;
+			break;
+		}
+	}
+
+	if (conn == NULL) {
+		shell_print(sh, "bench,cm_get_index_with_conn,%d,0,skipped",
+			    connections.size);
+		return;
+	}
+
+	start = timing_counter_get();
+	for (uint32_t i = 0; i < iterations; i++) {
+		sink = cm_get_index_with_conn(&connections, conn);
+	}
+	end = timing_counter_get();
+	bench_print(sh, "cm_get_index_with_conn", connections.size, iterations,
+		    timing_cycles_get(&start, &end));
+}
+
+static void bench_path(const struct shell *sh, uint32_t iterations)
+{
+	static const float quat[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	uint8_t pkt[SVR_ROTATION_LEN] = {0};
+	uint32_t gap = stats_gap_cycles();
+	timing_t start, end;
+	uint8_t *record;
+
+	start = timing_counter_get();
+	for (uint32_t i = 0; i < iterations; i++) {
+		cm_count_rx(&bench_map, 0, SVR_ROTATION_LEN, i, gap);
+	}
+	end = timing_counter_get();
+	bench_print(sh, "cm_count_rx", 1, iterations,
+		    timing_cycles_get(&start, &end));
+
+	/* One enqueue/dequeue pair, the way the RX path and sender use it */
+	start = timing_counter_get();
+	for (uint32_t i = 0; i < iterations; i++) {
+		(void)fwd_ring_put(&bench_ring, 0, pkt, sizeof(pkt), i);
+		(void)fwd_ring_peek(&bench_ring, 0);
+		fwd_ring_release(&bench_ring, 1);
+	}
+	end = timing_counter_get();
+	bench_print(sh, "fwd_ring_put_peek_release", 1, iterations,
+		    timing_cycles_get(&start, &end));
+
+	start = timing_counter_get();
+	for (uint32_t i = 0; i < iterations; i++) {
+		sink = svr_encode_rotation(pkt, 0, quat, 3);
+	}
+	end = timing_counter_get();
+	bench_print(sh, "svr_encode_rotation", 1, iterations,
+		    timing_cycles_get(&start, &end));
+
+	/* The record is built in place, so every call encodes again */
+	start = timing_counter_get();
+	for (uint32_t i = 0; i < iterations; i++) {
+		svr_encode_rotation(pkt, 0, quat, 3);
+		sink = svr_bundle_record(1, pkt, sizeof(pkt), &record);
+	}
+	end = timing_counter_get();
+	bench_print(sh, "svr_encode_rotation_bundle_record", 1, iterations,
+		    timing_cycles_get(&start, &end));
+}
+
+static int cmd_bench(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t iterations = BENCH_ITERATIONS;
+
+	if (argc > 1) {
+		iterations = strtoul(argv[1], NULL, 0);
+		if (iterations == 0) {
+			shell_error(sh, "Invalid iteration count %s", argv[1]);
+			return -EINVAL;
+		}
+	}
+
+	timing_init();
+	timing_start();
+
+	shell_print(sh, "bench,name,slots,iterations,cycles,cycles_per_call,"
+		    "ns_per_call");
+	bench_lookups(sh, iterations);
+	bench_live(sh, iterations);
+	bench_path(sh, iterations);
+
+	timing_stop();
+
+	return 0;
+}
+
+SHELL_CMD_ARG_REGISTER(bench, NULL,
+		       "Hot path microbenchmarks as CSV: bench [iterations]",
+		       cmd_bench, 1, 1);
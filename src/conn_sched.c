@@ -0,0 +1,192 @@
+/* conn_sched.c - Connection parameters for the current tracker count */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(conn_sched, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <errno.h>
+
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+#include <sdc_hci_vs.h>
+#endif
+
+#include "conn_sched.h"
+#include "stats.h"
+
+/* Connection interval and supervision timeout units */
+#define INTERVAL_UNIT_US 1250
+#define TIMEOUT_UNIT_US 10000
+
+#define SCHED_DEBOUNCE K_MSEC(100)
+
+static connection_map *connections;
+static struct bt_le_conn_param current;
+static uint32_t current_event_us;
+
+static void sched_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(sched_work, sched_handler);
+
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+/* Only applies to links created after the call */
+static int set_event_length(uint32_t event_us)
+{
+	sdc_hci_cmd_vs_event_length_set_t *cmd;
+	struct net_buf *buf;
+
+	buf = bt_hci_cmd_create(SDC_HCI_OPCODE_CMD_VS_EVENT_LENGTH_SET,
+				sizeof(*cmd));
+	if (buf == NULL) {
+		return -ENOBUFS;
+	}
+
+	cmd = net_buf_add(buf, sizeof(*cmd));
+	cmd->event_length_us = event_us;
+
+	return bt_hci_cmd_send_sync(SDC_HCI_OPCODE_CMD_VS_EVENT_LENGTH_SET, buf,
+				    NULL);
+}
+#endif
+
+static void compute(int links, uint32_t max_rate, struct bt_le_conn_param *param,
+		    uint32_t *event_us)
+{
+	uint32_t floor_us = MAX(links, 1) * CONFIG_SLIMEVR_CONN_EVENT_MIN_US;
+	uint32_t interval_us = MAX(floor_us, CONFIG_SLIMEVR_CONN_INTERVAL_MIN_US);
+	uint32_t latency = 0;
+
+	/* No point polling faster than the fastest tracker samples */
+	if (max_rate > 0) {
+		interval_us = MAX(interval_us, MIN(USEC_PER_SEC / max_rate,
+						  CONFIG_SLIMEVR_CONN_INTERVAL_MAX_US));
+	}
+
+	interval_us = ROUND_UP(interval_us, INTERVAL_UNIT_US);
+
+	/* Trackers that sample slower may skip the events in between */
+	if (max_rate > 0) {
+		latency = MIN(USEC_PER_SEC / max_rate / interval_us,
+			      CONFIG_SLIMEVR_CONN_LATENCY_MAX + 1);
+		latency = latency > 0 ? latency - 1 : 0;
+	}
+
+	param->interval_min = interval_us / INTERVAL_UNIT_US;
+	param->interval_max = param->interval_min;
+	param->latency = latency;
+	/* Survive a couple of missed events, never below the old 100 ms */
+	param->timeout = MAX(DIV_ROUND_UP((latency + 1) * interval_us * 6,
+					  TIMEOUT_UNIT_US), 10);
+
+	*event_us = interval_us / MAX(links, 1);
+}
+
+static void sched_handler(struct k_work *work)
+{
+	struct bt_le_conn_param param;
+	uint32_t max_rate = 0;
+	uint32_t event_us;
+	int links = 0;
+
+	for (int i = 0; i < connections->size; i++) {
+		struct tracker_rates rates;
+
+		if (connections->entry[i].connection == NULL) {
+			continue;
+		}
+
+		links++;
+
+		if (stats_get_tracker(i, &rates) == 0 && rates.active) {
+			max_rate = MAX(max_rate, rates.packets_per_sec);
+		}
+	}
+
+	compute(links, max_rate, &param, &event_us);
+
+	if (event_us != current_event_us) {
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+		if (set_event_length(event_us) == 0) {
+			current_event_us = event_us;
+		}
+#else
+		current_event_us = event_us;
+#endif
+	}
+
+	if (param.interval_max != current.interval_max ||
+	    param.latency != current.latency) {
+		LOG_INF("%d links at up to %u pkt/s: interval %u us, latency %u, "
+			"timeout %u ms, event %u us", links, max_rate,
+			param.interval_max * INTERVAL_UNIT_US, param.latency,
+			param.timeout * 10, event_us);
+	}
+
+	current = param;
+
+	for (int i = 0; i < connections->size; i++) {
+		connection_entry *entry = &connections->entry[i];
+		int err;
+
+		if (entry->connection == NULL ||
+		    (entry->interval_req == param.interval_max &&
+		     entry->latency_req == param.latency)) {
+			continue;
+		}
+
+		err = bt_conn_le_param_update(entry->connection, &param);
+		if (err) {
+			LOG_WRN("Tracker %d parameter update failed (err %d)", i, err);
+			continue;
+		}
+
+		entry->interval_req = param.interval_max;
+		entry->latency_req = param.latency;
+	}
+
+	k_work_reschedule(&sched_work, K_MSEC(CONFIG_SLIMEVR_CONN_SCHED_PERIOD_MS));
+}
+
+static void sched_occupancy_changed(struct bt_conn *conn, uint8_t err)
+{
+	k_work_reschedule(&sched_work, SCHED_DEBOUNCE);
+}
+
+static void sched_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	k_work_reschedule(&sched_work, SCHED_DEBOUNCE);
+}
+
+static void sched_param_updated(struct bt_conn *conn, uint16_t interval,
+				uint16_t latency, uint16_t timeout)
+{
+	int index;
+
+	if (connections == NULL) {
+		return;
+	}
+
+	index = cm_get_index_with_conn(connections, conn);
+	if (index < 0) {
+		return;
+	}
+
+	connections->entry[index].interval = interval;
+
+	LOG_INF("Tracker %d interval %u us (requested %u us), latency %u (requested %u)",
+		index, interval * INTERVAL_UNIT_US,
+		connections->entry[index].interval_req * INTERVAL_UNIT_US,
+		latency, connections->entry[index].latency_req);
+}
+
+BT_CONN_CB_DEFINE(conn_sched_callbacks) = {
+	.connected = sched_occupancy_changed,
+	.disconnected = sched_disconnected,
+	.le_param_updated = sched_param_updated,
+};
+
+void conn_sched_start(connection_map *cm)
+{
+	connections = cm;
+}
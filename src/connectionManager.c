@@ -15,29 +15,28 @@ int cm_get_next_free_object_index(connection_map *cm)
 
 int cm_remove_object_with_index(connection_map *cm, int index)
 {
-    if(cm->size < index)
+    if(index < 0 || index >= cm->size)
     {
         return -1;
     }
 
+    struct bt_conn *conn = cm->entry[index].connection;
+
+    if(conn != NULL && cm->conn_index[bt_conn_index(conn)] == index)
+    {
+        cm->conn_index[bt_conn_index(conn)] = -1;
+    }
+
     cm->entry[index].connection = NULL;
+    cm->rx[index].connection = NULL;
+    cm->entry[index].state = CM_STATE_IDLE;
 
     return 0;
 }
 
-int cm_remove_object_with_addr(connection_map *cm, char addr[BT_ADDR_LE_STR_LEN])
+int cm_remove_object_with_addr(connection_map *cm, const bt_addr_le_t *addr)
 {
-    for(int i = 0; i < cm->size; i++)
-    {
-        if(strcmp(addr, cm->entry[i].addr) == 0)
-        {
-            cm->entry[i].connection = NULL;
-
-            return 0;
-        }
-    }
-
-    return -1;
+    return cm_remove_object_with_index(cm, cm_get_index_with_addr(cm, addr));
 }
 
 int cm_add_object(connection_map *cm, connection_entry entry)
@@ -50,35 +49,67 @@ int cm_add_object(connection_map *cm, connection_entry entry)
     }
 
     memcpy(&cm->entry[index], &entry, sizeof(connection_entry));
+    cm->rx[index].connection = entry.connection;
+
+    if(entry.connection != NULL)
+    {
+        cm->conn_index[bt_conn_index(entry.connection)] = index;
+    }
 
     return 0;
 }
 
-int cm_get_index_with_addr(connection_map *cm, char addr[BT_ADDR_LE_STR_LEN])
+int cm_bind_conn(connection_map *cm, int index, struct bt_conn *conn)
 {
-    for(int i = 0; i < cm->size; i++)
+    if(index < 0 || index >= cm->size)
     {
-        if(strcmp(addr, cm->entry[i].addr) == 0)
-        {
-            return i;
-        }
+        return -1;
     }
 
-    return -1;
+    cm->entry[index].connection = conn;
+    cm->rx[index].connection = conn;
+    cm->entry[index].stalled = false;
+    cm->entry[index].interval_req = 0;
+    cm->entry[index].latency_req = 0;
+    cm->entry[index].interval = 0;
+    cm->conn_index[bt_conn_index(conn)] = index;
+
+    /* A new link is not a gap of the previous one */
+    atomic_inc(&cm->rx[index].seq);
+    cm->rx[index].last_rx = 0;
+    atomic_inc(&cm->rx[index].seq);
+
+    return 0;
 }
 
-int cm_get_index_with_conn(connection_map *cm, struct bt_conn *conn)
+int cm_get_index_with_addr(connection_map *cm, const bt_addr_le_t *addr)
 {
-    char addr[BT_ADDR_LE_STR_LEN];
-    bt_addr_le_to_str(bt_conn_get_dst(conn), addr, BT_ADDR_LE_STR_LEN);
-
     for(int i = 0; i < cm->size; i++)
     {
-        if(strcmp(addr, cm->entry[i].addr) == 0)
+        if(cm->entry[i].connection != NULL &&
+           bt_addr_le_eq(addr, &cm->entry[i].addr))
         {
             return i;
         }
     }
 
     return -1;
-}
\ No newline at end of file
+}
+
+void cm_read_counters(connection_map *cm, int index, connection_counters *out)
+{
+    connection_rx *rx = &cm->rx[index];
+    atomic_val_t seq;
+
+    do
+    {
+        seq = atomic_get(&rx->seq);
+
+        out->packets = rx->packets;
+        out->bytes = rx->bytes;
+        out->gaps = rx->gaps;
+        out->gap_cycles = rx->gap_cycles;
+        out->gap_max_cycles = rx->gap_max_cycles;
+        out->last_rx = rx->last_rx;
+    } while((seq & 1) || seq != atomic_get(&rx->seq));
+}
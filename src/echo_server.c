@@ -43,12 +43,18 @@ struct k_mem_domain app_domain;
 		    NET_EVENT_L4_DISCONNECTED)
 
 APP_DMEM struct configs conf = {
+#if defined(CONFIG_NET_IPV4)
 	.ipv4 = {
 		.proto = "IPv4",
+		.udp.sock = -1,
 	},
+#endif
+#if defined(CONFIG_NET_IPV6)
 	.ipv6 = {
 		.proto = "IPv6",
+		.udp.sock = -1,
 	},
+#endif
 };
 
 void quit(void)
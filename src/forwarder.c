@@ -0,0 +1,703 @@
+/* forwarder.c - BLE notification to UDP forwarding stage */
+
+/*
+ * The notification callback runs on the Bluetooth RX thread, which every
+ * link shares. It only copies the payload into a preallocated
+ * single-producer/single-consumer ring and returns. A dedicated sender
+ * thread drains the ring into the UDP socket created by the echo server.
+ *
+ * Samples from all trackers are packed into one SlimeVR bundle packet.
+ * A datagram is sent when its flush deadline expires or when the next
+ * record would not fit the path MTU. Records are not copied into a
+ * staging buffer: each slot is turned into a bundle record in place,
+ * stays in the ring until the datagram is sent and is gathered straight
+ * into the net_pkt by sendmsg() with an iovec per slot.
+ *
+ * With CONFIG_SLIMEVR_FWD_MAILBOX rotation packets skip the ring. Each
+ * tracker has a triple buffered mailbox holding only its newest
+ * rotation: the producer always owns one buffer, the sender owns the
+ * one it is packing and the third is swapped between them with one
+ * atomic operation. A sample the sender never got to is overwritten and
+ * counted, so a slow link delays the next sample instead of queueing
+ * stale ones.
+ *
+ * Packets are classified at ingest. Rotation and acceleration are
+ * realtime, everything else (battery, sensor info, logs) is bulk and
+ * has its own, lossless ring. Bulk records never share a datagram with
+ * realtime ones and only go out between realtime datagrams, or once the
+ * oldest has waited CONFIG_SLIMEVR_FWD_BULK_MAX_WAIT_MS.
+ *
+ * With CONFIG_SLIMEVR_FWD_FRAMES the mailboxes are only read on a fixed
+ * tick. Each tick sends one bundle holding the newest rotation of every
+ * tracker followed by an SVR_PACKET_FRAME_AGES record, so the server
+ * sees whole-body snapshots and how old each part of one is. A tracker
+ * with nothing new repeats its last rotation: the sender keeps owning
+ * the front buffer until a newer sample is taken, and the record built
+ * in it stays valid.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(forwarder, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/net/net_if.h>
+#include <errno.h>
+#include <string.h>
+
+#include "forwarder.h"
+#include "fwd_ring.h"
+#include "latency.h"
+#include "ram_budget.h"
+#include "slimevr_proto.h"
+
+#define FWD_TRACKERS CONFIG_SLIMEVR_MAX_TRACKERS
+/* Slots held by an unsent datagram, the rest stays free for the producer */
+#define FWD_MAX_RECORDS (CONFIG_SLIMEVR_FWD_RING_SIZE / 2)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_SLIMEVR_FWD_RING_SIZE),
+	     "CONFIG_SLIMEVR_FWD_RING_SIZE must be a power of two");
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_SLIMEVR_FWD_BULK_RING_SIZE),
+	     "CONFIG_SLIMEVR_FWD_BULK_RING_SIZE must be a power of two");
+
+enum fwd_class {
+	FWD_CLASS_REALTIME,
+	FWD_CLASS_BULK,
+	FWD_CLASS_COUNT,
+};
+
+static struct fwd_slot realtime_slots[CONFIG_SLIMEVR_FWD_RING_SIZE];
+static struct fwd_slot bulk_slots[CONFIG_SLIMEVR_FWD_BULK_RING_SIZE];
+
+static struct fwd_ring rings[FWD_CLASS_COUNT] = {
+	[FWD_CLASS_REALTIME] = {
+		.slot = realtime_slots,
+		.mask = CONFIG_SLIMEVR_FWD_RING_SIZE - 1,
+		.max_held = FWD_MAX_RECORDS,
+	},
+	[FWD_CLASS_BULK] = {
+		.slot = bulk_slots,
+		.mask = CONFIG_SLIMEVR_FWD_BULK_RING_SIZE - 1,
+		.max_held = MAX(MIN(CONFIG_SLIMEVR_FWD_BULK_RING_SIZE / 2,
+				    FWD_MAX_RECORDS), 1),
+	},
+};
+
+#if defined(CONFIG_SLIMEVR_FWD_MAILBOX)
+/* state holds the index of the shared buffer and MAILBOX_FRESH */
+#define MAILBOX_FRESH BIT(2)
+#define MAILBOX_INDEX(state) ((state) & 3)
+
+struct fwd_mailbox {
+	struct fwd_slot buf[3];
+	atomic_t state;
+	/* Owned by the producer and by the sender */
+	uint8_t back;
+	uint8_t front;
+	uint32_t overwrites;
+};
+
+static struct fwd_mailbox mailbox[FWD_TRACKERS];
+/* Trackers whose front buffer sits in the unsent datagram */
+static uint32_t mailbox_held;
+
+BUILD_ASSERT(FWD_TRACKERS <= 32, "mailbox_held has one bit per tracker");
+
+#define FWD_MAILBOX_RAM sizeof(struct fwd_mailbox)
+#else
+#define FWD_MAILBOX_RAM 0
+#endif
+
+static struct fwd_stats stats;
+
+static atomic_t fwd_sock = ATOMIC_INIT(-1);
+static struct k_spinlock peer_lock;
+static struct sockaddr_in peer;
+static bool peer_valid;
+
+#if defined(CONFIG_SLIMEVR_FWD_FRAMES)
+struct fwd_frame_record {
+	struct fwd_slot *slot;
+	uint8_t *start;
+	uint8_t len;
+};
+
+/* Last record packed from each mailbox's front buffer */
+static struct fwd_frame_record frame_record[FWD_TRACKERS];
+static uint8_t frame_ages[SVR_FRAME_AGES_LEN(FWD_TRACKERS)];
+static int64_t frame_next;
+
+/* A frame is the header, one record per tracker and the ages record */
+#define FWD_IOVS MAX(FWD_MAX_RECORDS, FWD_TRACKERS + 1)
+#define FWD_FRAME_RAM (sizeof(struct fwd_frame_record) + SVR_FRAME_AGE_LEN)
+#else
+#define FWD_IOVS FWD_MAX_RECORDS
+#define FWD_FRAME_RAM 0
+#endif
+
+/* Entry 0 is the bundle packet header */
+static struct iovec bundle[FWD_IOVS + 1];
+/* Slot behind every record */
+static struct fwd_slot *bundle_slot[FWD_IOVS];
+/* Sender thread only, every record of a datagram is of one class */
+static enum fwd_class bundle_class;
+static uint8_t bundle_header[SVR_HEADER_LEN];
+static size_t bundle_len;
+static size_t bundle_limit;
+static uint32_t bundle_samples;
+static int64_t bundle_deadline;
+
+RAM_BUDGET_DEFINE(forwarder, FWD_MAILBOX_RAM + FWD_FRAME_RAM,
+		  sizeof(realtime_slots) + sizeof(bulk_slots) + sizeof(bundle) +
+		  sizeof(bundle_slot));
+
+K_SEM_DEFINE(fwd_sem, 0, 1);
+
+#if defined(CONFIG_SLIMEVR_FWD_MAILBOX)
+static void mailbox_put(uint8_t tracker, const void *data, uint16_t length,
+			uint32_t stamp)
+{
+	struct fwd_mailbox *mb = &mailbox[tracker];
+	struct fwd_slot *slot = &mb->buf[mb->back];
+	atomic_val_t old;
+
+	slot->len = length;
+	slot->tracker = tracker;
+	slot->stamp = stamp;
+	memcpy(slot->data, data, length);
+
+	old = atomic_set(&mb->state, mb->back | MAILBOX_FRESH);
+	mb->back = MAILBOX_INDEX(old);
+
+	if (old & MAILBOX_FRESH) {
+		mb->overwrites++;
+	}
+
+	/* Frames are sent on the tick, not when samples arrive */
+	if (!IS_ENABLED(CONFIG_SLIMEVR_FWD_FRAMES)) {
+		k_sem_give(&fwd_sem);
+	}
+}
+
+/* Newest sample of a tracker if the sender has not seen it yet */
+static struct fwd_slot *mailbox_take(uint8_t tracker)
+{
+	struct fwd_mailbox *mb = &mailbox[tracker];
+	atomic_val_t old;
+
+	if (!(atomic_get(&mb->state) & MAILBOX_FRESH)) {
+		return NULL;
+	}
+
+	old = atomic_set(&mb->state, mb->front);
+	mb->front = MAILBOX_INDEX(old);
+
+	return &mb->buf[mb->front];
+}
+#endif
+
+static enum fwd_class fwd_classify(const uint8_t *data, uint16_t length)
+{
+	if (length < SVR_TYPE_LEN) {
+		return FWD_CLASS_BULK;
+	}
+
+	switch (sys_get_be32(data)) {
+	case SVR_PACKET_ROTATION_DATA:
+	case SVR_PACKET_ACCEL:
+		return FWD_CLASS_REALTIME;
+	default:
+		return FWD_CLASS_BULK;
+	}
+}
+
+int fwd_submit(uint8_t tracker, const void *data, uint16_t length,
+	       uint32_t stamp)
+{
+	enum fwd_class class;
+	int err;
+
+	stats.submitted++;
+
+	if (length > CONFIG_SLIMEVR_FWD_SLOT_SIZE) {
+		stats.dropped_size++;
+		return -EMSGSIZE;
+	}
+
+#if defined(CONFIG_SLIMEVR_FWD_MAILBOX)
+	if (tracker < FWD_TRACKERS && length >= SVR_TYPE_LEN &&
+	    sys_get_be32(data) == SVR_PACKET_ROTATION_DATA) {
+		mailbox_put(tracker, data, length, stamp);
+		return 0;
+	}
+#endif
+
+	class = fwd_classify(data, length);
+
+	err = fwd_ring_put(&rings[class], tracker, data, length, stamp);
+	if (err) {
+		return err;
+	}
+
+	k_sem_give(&fwd_sem);
+
+	return 0;
+}
+
+void fwd_attach_socket(int sock)
+{
+	atomic_set(&fwd_sock, sock);
+}
+
+void fwd_detach_socket(void)
+{
+	atomic_set(&fwd_sock, -1);
+}
+
+void fwd_set_peer(const struct sockaddr *addr, socklen_t addrlen)
+{
+	k_spinlock_key_t key;
+
+	if (addr->sa_family != AF_INET || addrlen < sizeof(peer)) {
+		return;
+	}
+
+	key = k_spin_lock(&peer_lock);
+	memcpy(&peer, addr, sizeof(peer));
+	peer_valid = true;
+	k_spin_unlock(&peer_lock, key);
+}
+
+void fwd_clear_peer(void)
+{
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&peer_lock);
+	peer_valid = false;
+	k_spin_unlock(&peer_lock, key);
+}
+
+void fwd_get_stats(struct fwd_stats *out)
+{
+	struct fwd_ring *realtime = &rings[FWD_CLASS_REALTIME];
+	struct fwd_ring *bulk = &rings[FWD_CLASS_BULK];
+
+	*out = stats;
+	out->dropped_full = realtime->dropped_full;
+	out->occupancy = fwd_ring_used(realtime);
+	out->high_water = realtime->high_water;
+	out->bulk_dropped_full = bulk->dropped_full;
+	out->bulk_occupancy = fwd_ring_used(bulk);
+	out->bulk_high_water = bulk->high_water;
+}
+
+uint32_t fwd_get_overwrites(uint8_t tracker)
+{
+#if defined(CONFIG_SLIMEVR_FWD_MAILBOX)
+	if (tracker < FWD_TRACKERS) {
+		return mailbox[tracker].overwrites;
+	}
+#endif
+
+	return 0;
+}
+
+static bool fwd_get_peer(struct sockaddr_in *dst)
+{
+	k_spinlock_key_t key;
+	bool valid;
+
+	key = k_spin_lock(&peer_lock);
+	*dst = peer;
+	valid = peer_valid;
+	k_spin_unlock(&peer_lock, key);
+
+	return valid;
+}
+
+/* Largest UDP payload that leaves the interface towards the peer unfragmented */
+static size_t fwd_path_limit(void)
+{
+	size_t limit = CONFIG_SLIMEVR_FWD_DATAGRAM_SIZE;
+	struct sockaddr_in dst;
+	struct net_if *iface;
+	size_t mtu;
+
+	if (!fwd_get_peer(&dst)) {
+		return limit;
+	}
+
+	iface = net_if_ipv4_select_src_iface(&dst.sin_addr);
+	if (iface == NULL) {
+		return limit;
+	}
+
+	mtu = net_if_get_mtu(iface);
+	if (mtu > NET_IPV4H_LEN + NET_UDPH_LEN) {
+		limit = MIN(limit, mtu - NET_IPV4H_LEN - NET_UDPH_LEN);
+	}
+
+	return limit;
+}
+
+static int fwd_transmit(int sock, struct sockaddr_in *dst, size_t iovlen)
+{
+	struct msghdr msg = {
+		.msg_name = dst,
+		.msg_namelen = sizeof(*dst),
+		.msg_iov = bundle,
+		.msg_iovlen = iovlen,
+	};
+
+	/*
+	 * The poll thread receives and replies on the same socket, so only
+	 * the socket layer touches its context. Never wait for buffers, a
+	 * late datagram is worth nothing.
+	 */
+	return sendmsg(sock, &msg, MSG_DONTWAIT);
+}
+
+static void fwd_flush(void)
+{
+	int sock = atomic_get(&fwd_sock);
+	struct sockaddr_in dst;
+	int ret;
+
+	if (bundle_samples == 0) {
+		return;
+	}
+
+	if (sock < 0 || !fwd_get_peer(&dst)) {
+		stats.dropped_no_peer += bundle_samples;
+		goto out;
+	}
+
+	ret = fwd_transmit(sock, &dst, bundle_samples + 1);
+	if (ret < 0) {
+		stats.send_errors++;
+		goto out;
+	}
+
+	/* Handed to the network stack, the samples' latency ends here */
+	uint32_t now = k_cycle_get_32();
+
+	for (uint32_t i = 0; i < bundle_samples; i++) {
+		latency_record(bundle_slot[i]->tracker, now - bundle_slot[i]->stamp);
+	}
+
+	stats.sent += bundle_samples;
+	stats.datagrams++;
+	stats.datagram_bytes += bundle_len;
+	if (bundle_class == FWD_CLASS_BULK) {
+		stats.bulk_sent += bundle_samples;
+	}
+
+out:
+	fwd_ring_release(&rings[bundle_class], rings[bundle_class].held);
+	rings[bundle_class].held = 0;
+#if defined(CONFIG_SLIMEVR_FWD_MAILBOX)
+	mailbox_held = 0;
+#endif
+	bundle_len = 0;
+	bundle_samples = 0;
+}
+
+/* Gives up a slot that cannot become a record */
+static void fwd_discard(struct fwd_ring *ring)
+{
+	stats.send_errors++;
+
+	if (ring != NULL) {
+		/* Slots are released in order, send what is held first */
+		fwd_flush();
+		fwd_ring_release(ring, 1);
+	}
+}
+
+/* Packs a ring slot, or a mailbox buffer when ring is NULL */
+static void fwd_pack(struct fwd_slot *slot, struct fwd_ring *ring)
+{
+	enum fwd_class class = ring != NULL ? ring - rings : FWD_CLASS_REALTIME;
+	uint8_t *start;
+	int record;
+
+	/* Classes never share a datagram */
+	if (bundle_samples > 0 && class != bundle_class) {
+		fwd_flush();
+	}
+
+	record = svr_bundle_record(slot->tracker, slot->data, slot->len, &start);
+	if (record < 0) {
+		fwd_discard(ring);
+		return;
+	}
+
+	if (bundle_samples > 0 && (bundle_len + record > bundle_limit ||
+				   bundle_samples == FWD_MAX_RECORDS ||
+				   (ring != NULL && ring->held == ring->max_held))) {
+		fwd_flush();
+	}
+
+	if (bundle_samples == 0) {
+		bundle_class = class;
+		bundle[0].iov_base = bundle_header;
+		bundle[0].iov_len = svr_encode_header(bundle_header,
+						      SVR_PACKET_BUNDLE);
+		bundle_len = bundle[0].iov_len;
+		bundle_limit = fwd_path_limit();
+		bundle_deadline = k_uptime_ticks() +
+				  k_us_to_ticks_ceil64(CONFIG_SLIMEVR_FWD_FLUSH_US);
+	}
+
+	/* Would only fit fragmented, counted on the consumer side */
+	if (bundle_len + record > bundle_limit) {
+		fwd_discard(ring);
+		return;
+	}
+
+	bundle_slot[bundle_samples] = slot;
+	bundle_samples++;
+	bundle[bundle_samples].iov_base = start;
+	bundle[bundle_samples].iov_len = record;
+	bundle_len += record;
+
+	if (ring != NULL) {
+		ring->held++;
+	}
+}
+
+#if defined(CONFIG_SLIMEVR_FWD_MAILBOX)
+static void fwd_pack_mailboxes(void)
+{
+	for (uint8_t i = 0; i < FWD_TRACKERS; i++) {
+		struct fwd_slot *slot;
+
+		/*
+		 * The front buffer is still referenced by the datagram. A newer
+		 * sample sends it now, holding it back until the deadline would
+		 * get the sample overwritten by the one after.
+		 */
+		if (mailbox_held & BIT(i)) {
+			if (!(atomic_get(&mailbox[i].state) & MAILBOX_FRESH)) {
+				continue;
+			}
+
+			fwd_flush();
+		}
+
+		slot = mailbox_take(i);
+		if (slot == NULL) {
+			continue;
+		}
+
+		fwd_pack(slot, NULL);
+
+		/* Packing may have flushed, so mark after the fact */
+		if (bundle_samples > 0 && bundle_slot[bundle_samples - 1] == slot) {
+			mailbox_held |= BIT(i);
+		}
+	}
+}
+#endif
+
+static void fwd_pack_realtime(void)
+{
+	struct fwd_ring *ring = &rings[FWD_CLASS_REALTIME];
+	struct fwd_slot *slot;
+
+	while ((slot = fwd_ring_peek(ring, ring->held)) != NULL) {
+		fwd_pack(slot, ring);
+	}
+
+#if defined(CONFIG_SLIMEVR_FWD_MAILBOX) && !defined(CONFIG_SLIMEVR_FWD_FRAMES)
+	fwd_pack_mailboxes();
+#endif
+}
+
+#if defined(CONFIG_SLIMEVR_FWD_FRAMES)
+/* Sends the newest rotation of every tracker as one bundle */
+static void fwd_send_frame(void)
+{
+	uint32_t max_age = k_ms_to_cyc_ceil32(CONFIG_SLIMEVR_FWD_FRAME_MAX_AGE_MS);
+	int sock = atomic_get(&fwd_sock);
+	uint8_t sensor_id[FWD_TRACKERS];
+	uint32_t age_us[FWD_TRACKERS];
+	struct sockaddr_in dst;
+	uint32_t fresh = 0;
+	size_t count = 0;
+	size_t limit;
+	size_t len;
+	uint32_t now;
+	int ret;
+
+	/* The frame reuses the bundle, send what the ring put there first */
+	fwd_flush();
+
+	limit = fwd_path_limit() - SVR_FRAME_AGES_LEN(FWD_TRACKERS);
+	len = svr_encode_header(bundle_header, SVR_PACKET_BUNDLE);
+	bundle[0].iov_base = bundle_header;
+	bundle[0].iov_len = len;
+	now = k_cycle_get_32();
+
+	for (uint8_t i = 0; i < FWD_TRACKERS; i++) {
+		struct fwd_frame_record *rec = &frame_record[i];
+		struct fwd_slot *slot = mailbox_take(i);
+
+		if (slot != NULL) {
+			int record = svr_bundle_record(slot->tracker, slot->data,
+						       slot->len, &rec->start);
+
+			if (record < 0) {
+				rec->slot = NULL;
+				stats.send_errors++;
+				continue;
+			}
+
+			rec->slot = slot;
+			rec->len = record;
+			fresh |= BIT(i);
+		}
+
+		if (rec->slot == NULL || now - rec->slot->stamp > max_age) {
+			continue;
+		}
+
+		if (len + rec->len > limit) {
+			if (fresh & BIT(i)) {
+				stats.dropped_size++;
+			}
+			continue;
+		}
+
+		bundle_slot[count] = rec->slot;
+		sensor_id[count] = i;
+		age_us[count] = k_cyc_to_us_floor32(now - rec->slot->stamp);
+		count++;
+		bundle[count].iov_base = rec->start;
+		bundle[count].iov_len = rec->len;
+		len += rec->len;
+	}
+
+	if (count == 0) {
+		return;
+	}
+
+	bundle[count + 1].iov_base = frame_ages;
+	bundle[count + 1].iov_len = svr_encode_frame_ages(frame_ages, sensor_id,
+							  age_us, count);
+	len += bundle[count + 1].iov_len;
+
+	if (sock < 0 || !fwd_get_peer(&dst)) {
+		stats.dropped_no_peer += POPCOUNT(fresh);
+		return;
+	}
+
+	ret = fwd_transmit(sock, &dst, count + 2);
+	if (ret < 0) {
+		stats.send_errors++;
+		return;
+	}
+
+	now = k_cycle_get_32();
+
+	for (size_t i = 0; i < count; i++) {
+		if (fresh & BIT(sensor_id[i])) {
+			latency_record(sensor_id[i], now - bundle_slot[i]->stamp);
+			stats.sent++;
+		} else {
+			stats.frame_repeated++;
+		}
+	}
+
+	stats.frames++;
+	stats.datagrams++;
+	stats.datagram_bytes += len;
+}
+
+/* Sends the frame when due, returns the ticks until the next one */
+static int64_t fwd_frame_tick(void)
+{
+	int64_t period = k_us_to_ticks_near64(USEC_PER_SEC /
+					      CONFIG_SLIMEVR_FWD_FRAME_HZ);
+	int64_t now = k_uptime_ticks();
+
+	if (now >= frame_next) {
+		fwd_send_frame();
+
+		/* Keep the phase unless the sender fell a whole tick behind */
+		frame_next += period;
+		if (frame_next <= now) {
+			frame_next = now + period;
+		}
+	}
+
+	return frame_next - now;
+}
+#endif
+
+/*
+ * Sends everything queued in the bulk ring as datagrams of its own, when
+ * no realtime datagram is being filled or the oldest bulk packet has
+ * waited too long for one to go out.
+ */
+static void fwd_send_bulk(void)
+{
+	struct fwd_ring *ring = &rings[FWD_CLASS_BULK];
+	struct fwd_slot *slot = fwd_ring_peek(ring, 0);
+
+	if (slot == NULL) {
+		return;
+	}
+
+	if (bundle_samples > 0) {
+		if (k_cycle_get_32() - slot->stamp <
+		    k_ms_to_cyc_ceil32(CONFIG_SLIMEVR_FWD_BULK_MAX_WAIT_MS)) {
+			return;
+		}
+
+		stats.bulk_starved++;
+		fwd_flush();
+	}
+
+	while ((slot = fwd_ring_peek(ring, ring->held)) != NULL) {
+		fwd_pack(slot, ring);
+	}
+
+	fwd_flush();
+}
+
+static void fwd_thread(void)
+{
+	while (true) {
+		k_timeout_t timeout = K_FOREVER;
+		int64_t remaining = INT64_MAX;
+
+		if (bundle_samples > 0) {
+			remaining = bundle_deadline - k_uptime_ticks();
+		}
+
+#if defined(CONFIG_SLIMEVR_FWD_FRAMES)
+		remaining = MIN(remaining, fwd_frame_tick());
+#endif
+
+		if (remaining != INT64_MAX) {
+			timeout = remaining > 0 ? K_TICKS(remaining) : K_NO_WAIT;
+		}
+
+		k_sem_take(&fwd_sem, timeout);
+
+		fwd_pack_realtime();
+
+		if (bundle_samples > 0 && k_uptime_ticks() >= bundle_deadline) {
+			fwd_flush();
+		}
+
+		fwd_send_bulk();
+	}
+}
+
+K_THREAD_DEFINE(fwd_thread_id, CONFIG_SLIMEVR_FWD_STACK_SIZE,
+		fwd_thread, NULL, NULL, NULL,
+		K_PRIO_PREEMPT(CONFIG_SLIMEVR_FWD_THREAD_PRIORITY), 0, 0);
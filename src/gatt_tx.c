@@ -0,0 +1,329 @@
+/* gatt_tx.c - Pooled per-tracker GATT command queues */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(gatt_tx, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/slist.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <string.h>
+#include <errno.h>
+
+#include "gatt_tx.h"
+#include "ram_budget.h"
+
+#define GATT_TX_TRACKERS CONFIG_SLIMEVR_MAX_TRACKERS
+/* Retry when the stack had no buffer and no completion will kick us */
+#define GATT_TX_RETRY K_MSEC(5)
+
+struct gatt_tx_cmd {
+	sys_snode_t node;
+	/* k_uptime_get_32() when queued */
+	uint32_t queued_ms;
+	uint16_t len;
+	uint8_t data[CONFIG_SLIMEVR_GATT_TX_CMD_SIZE];
+};
+
+struct gatt_tx_queue {
+	struct bt_conn *conn;
+	uint16_t handle;
+	bool without_response;
+	sys_slist_t cmds;
+	uint8_t depth;
+	/* Writes handed to the stack and not yet completed */
+	uint8_t in_flight;
+	struct bt_gatt_write_params write_params;
+	/* Read by the stack until write_cb(), long writes are split into
+	 * prepare writes that go out one by one */
+	struct gatt_tx_cmd *write_cmd;
+	struct gatt_tx_stats stats;
+};
+
+K_MEM_SLAB_DEFINE_STATIC(tx_slab, sizeof(struct gatt_tx_cmd),
+			 CONFIG_SLIMEVR_GATT_TX_BUFFERS, 4);
+
+static struct gatt_tx_queue queues[GATT_TX_TRACKERS];
+
+/* Every tracker gets the handshake right after subscribing */
+BUILD_ASSERT(CONFIG_SLIMEVR_GATT_TX_BUFFERS >= GATT_TX_TRACKERS,
+	     "Fewer command buffers than trackers");
+
+RAM_BUDGET_DEFINE(gatt_tx, sizeof(struct gatt_tx_queue),
+		  CONFIG_SLIMEVR_GATT_TX_BUFFERS * sizeof(struct gatt_tx_cmd));
+static struct k_spinlock tx_lock;
+
+static void tx_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(tx_work, tx_handler);
+
+static void sent_cb(struct bt_conn *conn, void *user_data)
+{
+	struct gatt_tx_queue *q = user_data;
+	k_spinlock_key_t key = k_spin_lock(&tx_lock);
+
+	if (q->conn == conn && q->in_flight > 0) {
+		q->in_flight--;
+		q->stats.completed++;
+	}
+
+	k_spin_unlock(&tx_lock, key);
+
+	k_work_reschedule(&tx_work, K_NO_WAIT);
+}
+
+static void write_cb(struct bt_conn *conn, uint8_t err,
+		     struct bt_gatt_write_params *params)
+{
+	struct gatt_tx_queue *q = CONTAINER_OF(params, struct gatt_tx_queue,
+					       write_params);
+	k_spinlock_key_t key = k_spin_lock(&tx_lock);
+	struct gatt_tx_cmd *cmd = q->write_cmd;
+
+	/* Also after a detach, the stack held on to it until now */
+	q->write_cmd = NULL;
+
+	if (q->conn == conn && q->in_flight > 0) {
+		q->in_flight--;
+		if (err) {
+			q->stats.errors++;
+		} else {
+			q->stats.completed++;
+		}
+	}
+
+	k_spin_unlock(&tx_lock, key);
+
+	if (cmd != NULL) {
+		k_mem_slab_free(&tx_slab, cmd);
+	}
+
+	k_work_reschedule(&tx_work, K_NO_WAIT);
+}
+
+/*
+ * Hands one command to the stack. Writes without response copy it into
+ * the ATT PDU, write requests keep using it until write_cb().
+ */
+static int tx_one(struct gatt_tx_queue *q, struct gatt_tx_cmd *cmd)
+{
+	if (q->without_response) {
+		return bt_gatt_write_without_response_cb(q->conn, q->handle,
+							 cmd->data, cmd->len,
+							 false, sent_cb, q);
+	}
+
+	q->write_params.func = write_cb;
+	q->write_params.handle = q->handle;
+	q->write_params.offset = 0;
+	q->write_params.data = cmd->data;
+	q->write_params.length = cmd->len;
+
+	return bt_gatt_write(q->conn, &q->write_params);
+}
+
+static bool drain(struct gatt_tx_queue *q)
+{
+	int limit = q->without_response ? CONFIG_SLIMEVR_GATT_TX_BURST : 1;
+	struct gatt_tx_cmd *cmd;
+	k_spinlock_key_t key;
+	bool referenced;
+	int err;
+
+	for (;;) {
+		key = k_spin_lock(&tx_lock);
+
+		if (q->conn == NULL || q->in_flight >= limit ||
+		    q->write_cmd != NULL) {
+			k_spin_unlock(&tx_lock, key);
+			return false;
+		}
+
+		cmd = SYS_SLIST_PEEK_HEAD_CONTAINER(&q->cmds, cmd, node);
+		if (cmd == NULL) {
+			k_spin_unlock(&tx_lock, key);
+			return false;
+		}
+
+		sys_slist_get_not_empty(&q->cmds);
+		q->depth--;
+
+		/* A late command is worse than a lost one, the server resends */
+		if (CONFIG_SLIMEVR_GATT_TX_MAX_AGE_MS > 0 &&
+		    k_uptime_get_32() - cmd->queued_ms > CONFIG_SLIMEVR_GATT_TX_MAX_AGE_MS) {
+			q->stats.pending--;
+			q->stats.expired++;
+			k_spin_unlock(&tx_lock, key);
+			k_mem_slab_free(&tx_slab, cmd);
+			continue;
+		}
+
+		q->in_flight++;
+		referenced = !q->without_response;
+		if (referenced) {
+			q->write_cmd = cmd;
+		}
+
+		k_spin_unlock(&tx_lock, key);
+
+		/* No blocking on the system work queue, busy stacks fail fast */
+		err = tx_one(q, cmd);
+
+		key = k_spin_lock(&tx_lock);
+
+		if (err && referenced) {
+			q->write_cmd = NULL;
+		}
+
+		if (err == -ENOMEM || err == -ENOBUFS || err == -EAGAIN) {
+			q->in_flight--;
+			q->depth++;
+			sys_slist_prepend(&q->cmds, &cmd->node);
+			k_spin_unlock(&tx_lock, key);
+			return true;
+		}
+
+		q->stats.pending--;
+		if (err) {
+			q->in_flight--;
+			q->stats.errors++;
+		} else {
+			q->stats.sent++;
+		}
+
+		k_spin_unlock(&tx_lock, key);
+
+		/* A write request that went out is freed by write_cb() */
+		if (err || !referenced) {
+			k_mem_slab_free(&tx_slab, cmd);
+		}
+	}
+}
+
+static void tx_handler(struct k_work *work)
+{
+	bool retry = false;
+
+	for (int i = 0; i < ARRAY_SIZE(queues); i++) {
+		retry |= drain(&queues[i]);
+	}
+
+	if (retry) {
+		k_work_reschedule(&tx_work, GATT_TX_RETRY);
+	}
+}
+
+void gatt_tx_attach(uint8_t tracker, struct bt_conn *conn, uint16_t handle,
+		    bool without_response)
+{
+	k_spinlock_key_t key;
+
+	if (tracker >= ARRAY_SIZE(queues)) {
+		return;
+	}
+
+	key = k_spin_lock(&tx_lock);
+
+	queues[tracker].conn = conn;
+	queues[tracker].handle = handle;
+	queues[tracker].without_response = without_response;
+	queues[tracker].in_flight = 0;
+
+	k_spin_unlock(&tx_lock, key);
+
+	k_work_reschedule(&tx_work, K_NO_WAIT);
+}
+
+void gatt_tx_detach(uint8_t tracker)
+{
+	struct gatt_tx_queue *q;
+	sys_slist_t dropped;
+	struct gatt_tx_cmd *cmd;
+	struct gatt_tx_cmd *next;
+	k_spinlock_key_t key;
+
+	if (tracker >= ARRAY_SIZE(queues)) {
+		return;
+	}
+
+	q = &queues[tracker];
+
+	key = k_spin_lock(&tx_lock);
+
+	dropped = q->cmds;
+	sys_slist_init(&q->cmds);
+	q->conn = NULL;
+	q->depth = 0;
+	q->in_flight = 0;
+	q->stats.pending = 0;
+
+	k_spin_unlock(&tx_lock, key);
+
+	SYS_SLIST_FOR_EACH_CONTAINER_SAFE(&dropped, cmd, next, node) {
+		k_mem_slab_free(&tx_slab, cmd);
+	}
+}
+
+int gatt_tx_send(uint8_t tracker, const void *data, uint16_t len)
+{
+	struct gatt_tx_queue *q;
+	struct gatt_tx_cmd *cmd;
+	k_spinlock_key_t key;
+
+	if (tracker >= ARRAY_SIZE(queues) || len > sizeof(cmd->data)) {
+		return -EINVAL;
+	}
+
+	q = &queues[tracker];
+
+	if (k_mem_slab_alloc(&tx_slab, (void **)&cmd, K_NO_WAIT)) {
+		key = k_spin_lock(&tx_lock);
+		q->stats.no_buffer++;
+		k_spin_unlock(&tx_lock, key);
+		return -ENOMEM;
+	}
+
+	cmd->queued_ms = k_uptime_get_32();
+	cmd->len = len;
+	memcpy(cmd->data, data, len);
+
+	key = k_spin_lock(&tx_lock);
+
+	if (q->conn == NULL) {
+		k_spin_unlock(&tx_lock, key);
+		k_mem_slab_free(&tx_slab, cmd);
+		return -ENOTCONN;
+	}
+
+	if (q->depth >= CONFIG_SLIMEVR_GATT_TX_QUEUE_MAX) {
+		q->stats.queue_full++;
+		k_spin_unlock(&tx_lock, key);
+		k_mem_slab_free(&tx_slab, cmd);
+		return -ENOBUFS;
+	}
+
+	sys_slist_append(&q->cmds, &cmd->node);
+	q->depth++;
+	q->stats.queued++;
+	q->stats.pending++;
+
+	k_spin_unlock(&tx_lock, key);
+
+	k_work_reschedule(&tx_work, K_NO_WAIT);
+
+	return 0;
+}
+
+int gatt_tx_get_stats(uint8_t tracker, struct gatt_tx_stats *stats)
+{
+	k_spinlock_key_t key;
+
+	if (tracker >= ARRAY_SIZE(queues)) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&tx_lock);
+	*stats = queues[tracker].stats;
+	k_spin_unlock(&tx_lock, key);
+
+	return 0;
+}
@@ -0,0 +1,192 @@
+/* handle_cache.c - GATT handle cache for returning trackers */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(handle_cache, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "handle_cache.h"
+#include "ram_budget.h"
+
+#define HANDLE_CACHE_KEY "svr_gatt"
+
+struct handle_cache_entry {
+	bt_addr_le_t addr;
+	uint16_t value_handle;
+	uint16_t ccc_handle;
+	uint8_t properties;
+};
+
+static struct handle_cache_entry cache[CONFIG_SLIMEVR_GATT_CACHE_SIZE];
+/* Next slot to replace once the cache is full */
+static int next_victim;
+
+/* Sized by CONFIG_SLIMEVR_GATT_CACHE_SIZE, not by the tracker count */
+RAM_BUDGET_DEFINE(handle_cache, 0, sizeof(cache));
+
+static K_MUTEX_DEFINE(cache_lock);
+
+#if defined(CONFIG_SLIMEVR_GATT_CACHE_SETTINGS)
+/* Slots changed in RAM and not yet written to flash */
+static ATOMIC_DEFINE(dirty, CONFIG_SLIMEVR_GATT_CACHE_SIZE);
+
+static void store_handler(struct k_work *work);
+
+static K_WORK_DEFINE(store_work, store_handler);
+#endif
+
+static int find(const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < ARRAY_SIZE(cache); i++) {
+		if (cache[i].value_handle != 0 && bt_addr_le_eq(addr, &cache[i].addr)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static int find_free(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(cache); i++) {
+		if (cache[i].value_handle == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+#if defined(CONFIG_SLIMEVR_GATT_CACHE_SETTINGS)
+/* Writes flash on the system work queue, never on the BT RX thread */
+static void store_handler(struct k_work *work)
+{
+	for (int i = 0; i < ARRAY_SIZE(cache); i++) {
+		char key[sizeof(HANDLE_CACHE_KEY "/") + 3];
+		struct handle_cache_entry entry;
+		int err;
+
+		if (!atomic_test_and_clear_bit(dirty, i)) {
+			continue;
+		}
+
+		k_mutex_lock(&cache_lock, K_FOREVER);
+		entry = cache[i];
+		k_mutex_unlock(&cache_lock);
+
+		snprintf(key, sizeof(key), HANDLE_CACHE_KEY "/%d", i);
+
+		if (entry.value_handle == 0) {
+			err = settings_delete(key);
+		} else {
+			err = settings_save_one(key, &entry, sizeof(entry));
+		}
+
+		if (err) {
+			LOG_WRN("Failed to store %s (err %d)", key, err);
+		}
+	}
+}
+#endif
+
+static void store(int index)
+{
+#if defined(CONFIG_SLIMEVR_GATT_CACHE_SETTINGS)
+	atomic_set_bit(dirty, index);
+	k_work_submit(&store_work);
+#endif
+}
+
+int handle_cache_get(const bt_addr_le_t *addr, uint16_t *value_handle,
+		     uint16_t *ccc_handle, uint8_t *properties)
+{
+	int index;
+
+	k_mutex_lock(&cache_lock, K_FOREVER);
+
+	index = find(addr);
+	if (index >= 0) {
+		*value_handle = cache[index].value_handle;
+		*ccc_handle = cache[index].ccc_handle;
+		*properties = cache[index].properties;
+	}
+
+	k_mutex_unlock(&cache_lock);
+
+	return index < 0 ? -ENOENT : 0;
+}
+
+void handle_cache_put(const bt_addr_le_t *addr, uint16_t value_handle,
+		      uint16_t ccc_handle, uint8_t properties)
+{
+	int index;
+
+	k_mutex_lock(&cache_lock, K_FOREVER);
+
+	index = find(addr);
+	if (index >= 0 && cache[index].value_handle == value_handle &&
+	    cache[index].ccc_handle == ccc_handle &&
+	    cache[index].properties == properties) {
+		k_mutex_unlock(&cache_lock);
+		return;
+	}
+
+	if (index < 0) {
+		index = find_free();
+	}
+
+	if (index < 0) {
+		index = next_victim;
+		next_victim = (next_victim + 1) % ARRAY_SIZE(cache);
+	}
+
+	bt_addr_le_copy(&cache[index].addr, addr);
+	cache[index].value_handle = value_handle;
+	cache[index].ccc_handle = ccc_handle;
+	cache[index].properties = properties;
+	store(index);
+
+	k_mutex_unlock(&cache_lock);
+}
+
+void handle_cache_remove(const bt_addr_le_t *addr)
+{
+	int index;
+
+	k_mutex_lock(&cache_lock, K_FOREVER);
+
+	index = find(addr);
+	if (index >= 0) {
+		memset(&cache[index], 0, sizeof(cache[index]));
+		store(index);
+	}
+
+	k_mutex_unlock(&cache_lock);
+}
+
+#if defined(CONFIG_SLIMEVR_GATT_CACHE_SETTINGS)
+static int handle_cache_set(const char *name, size_t len,
+			    settings_read_cb read_cb, void *cb_arg)
+{
+	int index = atoi(name);
+	ssize_t ret;
+
+	if (index < 0 || index >= ARRAY_SIZE(cache) ||
+	    len != sizeof(cache[index])) {
+		return -EINVAL;
+	}
+
+	ret = read_cb(cb_arg, &cache[index], sizeof(cache[index]));
+
+	return ret < 0 ? ret : 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(handle_cache, HANDLE_CACHE_KEY, NULL,
+			       handle_cache_set, NULL, NULL);
+#endif
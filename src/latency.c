@@ -0,0 +1,89 @@
+/* latency.c - Per-tracker notification to transmit latency histograms */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/atomic.h>
+#include <errno.h>
+#include <string.h>
+
+#include "latency.h"
+#include "ram_budget.h"
+
+struct latency_hist {
+	uint32_t bucket[LATENCY_BUCKETS];
+	uint32_t count;
+	uint32_t max_us;
+};
+
+/* Only written by the forwarding sender thread, readers request resets */
+static struct latency_hist hist[LATENCY_TRACKERS];
+static ATOMIC_DEFINE(reset_pending, LATENCY_TRACKERS);
+
+RAM_BUDGET_DEFINE(latency, sizeof(struct latency_hist), sizeof(reset_pending));
+
+void latency_record(uint8_t tracker, uint32_t cycles)
+{
+	uint32_t us = k_cyc_to_us_floor32(cycles);
+	struct latency_hist *h;
+	int bucket;
+
+	if (tracker >= LATENCY_TRACKERS) {
+		return;
+	}
+
+	h = &hist[tracker];
+	if (atomic_test_and_clear_bit(reset_pending, tracker)) {
+		memset(h, 0, sizeof(*h));
+	}
+
+	bucket = us ? 32 - __builtin_clz(us) : 0;
+
+	h->bucket[MIN(bucket, LATENCY_BUCKETS - 1)]++;
+	h->count++;
+	if (us > h->max_us) {
+		h->max_us = us;
+	}
+}
+
+static uint32_t percentile(const struct latency_hist *h, uint32_t count,
+			   uint32_t pct)
+{
+	uint32_t rank = DIV_ROUND_UP((uint64_t)count * pct, 100);
+	uint32_t seen = 0;
+
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (seen >= rank) {
+			return i ? BIT(i) : 1;
+		}
+	}
+
+	return h->max_us;
+}
+
+int latency_get(uint8_t tracker, struct latency_summary *summary)
+{
+	struct latency_hist h;
+
+	if (tracker >= LATENCY_TRACKERS) {
+		return -EINVAL;
+	}
+
+	h = hist[tracker];
+
+	summary->count = h.count;
+	summary->max_us = h.max_us;
+	summary->p50_us = h.count ? MIN(percentile(&h, h.count, 50), h.max_us) : 0;
+	summary->p99_us = h.count ? MIN(percentile(&h, h.count, 99), h.max_us) : 0;
+
+	return 0;
+}
+
+void latency_reset(uint8_t tracker)
+{
+	if (tracker >= LATENCY_TRACKERS) {
+		return;
+	}
+
+	atomic_set_bit(reset_pending, tracker);
+}
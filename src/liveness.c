@@ -0,0 +1,60 @@
+/* liveness.c - Watchdog for trackers that stop notifying */
+
+/*
+ * A tracker can stop notifying while its link layer keeps answering, so
+ * the supervision timeout never fires. The watchdog looks at the last
+ * notification time the RX path already keeps in every entry.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(liveness, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+
+#include "liveness.h"
+
+#define LIVENESS_PERIOD K_MSEC(MAX(CONFIG_SLIMEVR_LIVENESS_TIMEOUT_MS / 4, 1))
+
+static connection_map *connections;
+
+static void liveness_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(liveness_work, liveness_handler);
+
+static void liveness_handler(struct k_work *work)
+{
+	uint32_t timeout = k_ms_to_cyc_ceil32(CONFIG_SLIMEVR_LIVENESS_TIMEOUT_MS);
+	uint32_t now = k_cycle_get_32();
+
+	for (int i = 0; i < connections->size; i++) {
+		connection_entry *entry = &connections->entry[i];
+		connection_counters c;
+
+		if (entry->state != CM_STATE_STREAMING || entry->stalled) {
+			continue;
+		}
+
+		cm_read_counters(connections, i, &c);
+
+		if (c.last_rx == 0 || now - c.last_rx <= timeout) {
+			continue;
+		}
+
+		LOG_WRN("Tracker %d silent for %u ms, reconnecting", i,
+			k_cyc_to_ms_floor32(now - c.last_rx));
+
+		entry->stalled = true;
+		entry->stalls++;
+		bt_conn_disconnect(entry->connection, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+	}
+
+	k_work_reschedule(&liveness_work, LIVENESS_PERIOD);
+}
+
+void liveness_start(connection_map *cm)
+{
+	connections = cm;
+	k_work_reschedule(&liveness_work, LIVENESS_PERIOD);
+}
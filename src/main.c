@@ -17,15 +17,26 @@
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/gatt.h>
-#include <bluetooth/scan.h>
 #include <bluetooth/gatt_dm.h>
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/drivers/gpio.h>
-#include <nrf52840.h>
+#include <zephyr/settings/settings.h>
 
-#include <zephyr/net/loopback.h>
 #include <zephyr/logging/log.h>
 #include "echo_server.h"
+#include "forwarder.h"
+#include "slimevr_client.h"
+#include "stats.h"
+#include "handle_cache.h"
+#include "gatt_tx.h"
+#include "conn_sched.h"
+#include "liveness.h"
+#include "tracker_registry.h"
+#include "adv_filter.h"
+#include "slimevr_gatt.h"
+#include "time_sync.h"
+#include "tracker_rx.h"
+#include "ram_budget.h"
 
 LOG_MODULE_REGISTER(foo, LOG_LEVEL_ERR);
 
@@ -37,88 +48,76 @@ LOG_MODULE_REGISTER(foo, LOG_LEVEL_ERR);
 
 static void start_scan(void);
 static bool stop_scan();
+static void discovery_next(void);
+static void discovery_queue(int index);
+static void resume_connecting(void);
+static int reconnect_stalled(void);
 
-#define UUID_SLIME_VR_VAL BT_UUID_128_ENCODE(0x677abafc, 0x4bd7, 0xcfa8, 0x014e, 0xbb1444f02608)
-#define UUID_SLIME_VR BT_UUID_DECLARE_128(UUID_SLIME_VR_VAL)
-#define UUID_SLIME_VR_CHR_VAL BT_UUID_128_ENCODE(0x6fd1aa9d, 0xd1da, 0xca9f, 0x144b, 0x8118aaae7c9d)
-#define UUID_SLIME_VR_CHR BT_UUID_DECLARE_128(UUID_SLIME_VR_CHR_VAL)
+CONNECTION_MAP_INIT(connections, CONFIG_SLIMEVR_MAX_TRACKERS)
 
-CONNECTION_MAP_INIT(connections, 6)
+RAM_BUDGET_DEFINE(connections,
+		  sizeof(connection_entry) + sizeof(connection_rx),
+		  sizeof(connectionsconn_index));
 
-int current_connection_index = -1;
+/* The controller initiates one link at a time, discovery runs one at a time */
+int connecting_index = -1;
+int discovering_index = -1;
 
-int slimevr_send(struct bt_conn *conn, const uint8_t *data, uint16_t length);
-
-bool ad_decode(struct bt_data *data, void *user_data)
-{
-	switch(data->type)
-	{
-		case BT_DATA_UUID128_ALL:
-			for(int i = 0; i < data->data_len; i++)
-			{
-				printk("%x", data->data[i]);
-			}
-			
-			return true;
-		case BT_DATA_NAME_COMPLETE:
-			printk("%s\n", data->data);
-			
-			return true;
-		default: 
-	}
-
-	return false;
-}
-
-void scan_filter_match(struct bt_scan_device_info *device_info,
-			     struct bt_scan_filter_match *filter_match,
-			     bool connectable)
+static void scan_recv(const struct bt_le_scan_recv_info *info,
+		      struct net_buf_simple *ad)
 {
-	char addr_str[BT_ADDR_LE_STR_LEN];
+	const struct adv_candidate *candidate;
 	int err;
 
-	if(cm_get_next_free_object_index(&connections) < 0)
-	{
-		printk("Too many devices connected\n");
+	/* Every report, scan responses are not connectable but carry the name */
+	candidate = adv_filter_match(info, ad);
+	if (candidate == NULL) {
 		return;
 	}
 
-	bt_addr_le_to_str(device_info->recv_info->addr, addr_str, sizeof(addr_str));
-	printk("Device found: %s (RSSI %d)\n", addr_str, device_info->recv_info->rssi);
+	if(connecting_index >= 0 ||
+	   cm_get_index_with_addr(&connections, info->addr) >= 0)
+	{
+		return;
+	}
 
-	bt_data_parse(device_info->adv_data, ad_decode, NULL);
+	int index = cm_get_next_free_object_index(&connections);
+	if(index < 0)
+	{
+		return;
+	}
 
-	if (stop_scan()) {
+	if (!(info->adv_props & BT_GAP_ADV_PROP_CONNECTABLE)) {
 		return;
 	}
 
-	current_connection_index = cm_get_next_free_object_index(&connections);
-	if(current_connection_index < 0)
-	{
+	if (stop_scan()) {
 		return;
 	}
 
-	memcpy(connections.entry[current_connection_index].addr, addr_str, BT_ADDR_LE_STR_LEN); 
-	err = bt_conn_le_create(device_info->recv_info->addr, BT_CONN_LE_CREATE_CONN,
-				BT_LE_CONN_PARAM_DEFAULT, &connections.entry[current_connection_index].connection);
+	struct bt_conn *conn;
+
+	bt_addr_le_copy(&connections.entry[index].addr, info->addr);
+	err = bt_conn_le_create(info->addr, BT_CONN_LE_CREATE_CONN,
+				BT_LE_CONN_PARAM_DEFAULT, &conn);
 	if (err) {
-		printk("Create conn to %s failed (%d)\n", addr_str, err);
-		start_scan();
+		printk("Create conn to tracker %04x failed (%d)\n",
+		       candidate->tracker_id, err);
+		resume_connecting();
+		return;
 	}
-}
 
-void scan_filter_no_match(struct bt_scan_device_info *device_info,
-				bool connectable)
-{
-	// for(int i = 0; i < device_info->adv_data->len; i++)
-	// {
-	// 	printk("%c", device_info->adv_data->data[i]);
-	// }	
+	printk("Connecting to tracker %04x %s (RSSI %d)\n", candidate->tracker_id,
+	       candidate->name, candidate->rssi);
 
-	// printk("\n");
+	cm_bind_conn(&connections, index, conn);
+	cm_set_state(&connections.entry[index], CM_STATE_CONNECTING);
+	connecting_index = index;
 }
 
-BT_SCAN_CB_INIT(scan_cb, scan_filter_match, scan_filter_no_match, NULL, NULL);
+static struct bt_le_scan_cb scan_cb = {
+	.recv = scan_recv,
+};
 
 bool already_scanning = false;
 
@@ -157,37 +156,228 @@ static bool stop_scan()
 	return err;
 }
 
-uint64_t count_messages = 0;
-int64_t timer = 0;
+#if defined(CONFIG_SLIMEVR_REGISTRY)
+/*
+ * Known trackers are connected by the controller straight from the
+ * accept list, without scanning or parsing their adverts first. Open
+ * scanning only takes over once the accept list has been initiating for
+ * CONFIG_SLIMEVR_AUTOCONNECT_TIMEOUT_MS without a link, to find new
+ * trackers and known ones that did not show up.
+ */
+static bool autoconnect_active;
+static uint32_t autoconnect_cycles;
+
+static void autoconnect_timeout_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(autoconnect_timeout, autoconnect_timeout_handler);
+
+static int autoconnect_start(void)
+{
+	bt_addr_le_t known[CONFIG_SLIMEVR_REGISTRY_SIZE];
+	int count = registry_get_all(known, ARRAY_SIZE(known));
+	int listed = 0;
+	int err;
+
+	if (already_scanning && stop_scan()) {
+		return -EBUSY;
+	}
+
+	bt_le_filter_accept_list_clear();
+
+	for (int i = 0; i < count; i++) {
+		if (cm_get_index_with_addr(&connections, &known[i]) >= 0) {
+			continue;
+		}
+
+		if (bt_le_filter_accept_list_add(&known[i]) == 0) {
+			listed++;
+		}
+	}
+
+	if (listed == 0) {
+		return -ENOENT;
+	}
+
+	err = bt_conn_le_create_auto(BT_CONN_LE_CREATE_CONN, BT_LE_CONN_PARAM_DEFAULT);
+	if (err) {
+		printk("Auto connect failed to start (err %d)\n", err);
+		return err;
+	}
+
+	autoconnect_active = true;
+	autoconnect_cycles = k_cycle_get_32();
+	k_work_reschedule(&autoconnect_timeout,
+			  K_MSEC(CONFIG_SLIMEVR_AUTOCONNECT_TIMEOUT_MS));
+
+	printk("Auto connecting to %d known trackers\n", listed);
+
+	return 0;
+}
+
+static void autoconnect_timeout_handler(struct k_work *work)
+{
+	if (!autoconnect_active) {
+		return;
+	}
+
+	autoconnect_active = false;
+	bt_conn_create_auto_stop();
+
+	if (reconnect_stalled() != 0) {
+		start_scan();
+	}
+}
+
+static bool is_central(struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+
+	return bt_conn_get_info(conn, &info) == 0 && info.role == BT_CONN_ROLE_CENTRAL;
+}
+
+/* Takes a slot for a link the controller made from the accept list */
+static int autoconnect_bind(struct bt_conn *conn)
+{
+	int index;
+
+	autoconnect_active = false;
+	k_work_cancel_delayable(&autoconnect_timeout);
+
+	index = cm_get_next_free_object_index(&connections);
+	if (index < 0) {
+		return index;
+	}
+
+	bt_addr_le_copy(&connections.entry[index].addr, bt_conn_get_dst(conn));
+	cm_bind_conn(&connections, index, bt_conn_ref(conn));
+	connections.entry[index].state = CM_STATE_CONNECTING;
+	connections.entry[index].state_cycles[CM_STATE_CONNECTING] = autoconnect_cycles;
+
+	return index;
+}
+#endif
+
+/* Reconnects a tracker the liveness watchdog dropped, straight to its address */
+static int reconnect_stalled(void)
+{
+	struct bt_conn *conn;
+	int err;
+
+	for (int i = 0; i < connections.size; i++) {
+		connection_entry *entry = &connections.entry[i];
+
+		if (entry->connection != NULL || !entry->stalled) {
+			continue;
+		}
+
+		/* One directed attempt, scanning picks it up otherwise */
+		entry->stalled = false;
+
+		if (already_scanning && stop_scan()) {
+			return -EBUSY;
+		}
+
+		err = bt_conn_le_create(&entry->addr, BT_CONN_LE_CREATE_CONN,
+					BT_LE_CONN_PARAM_DEFAULT, &conn);
+		if (err) {
+			printk("Reconnect to tracker %d failed (%d)\n", i, err);
+			return err;
+		}
+
+		cm_bind_conn(&connections, i, conn);
+		cm_set_state(entry, CM_STATE_CONNECTING);
+		connecting_index = i;
+
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+/* Picks how the next tracker gets connected once the controller is free */
+static void resume_connecting(void)
+{
+	if (connecting_index >= 0 ||
+	    cm_get_next_free_object_index(&connections) < 0) {
+		return;
+	}
+
+#if defined(CONFIG_SLIMEVR_REGISTRY)
+	if (autoconnect_active) {
+		return;
+	}
+#endif
+
+	if (reconnect_stalled() == 0) {
+		return;
+	}
+
+#if defined(CONFIG_SLIMEVR_REGISTRY)
+	if (autoconnect_start() == 0) {
+		return;
+	}
+#endif
+
+	start_scan();
+}
+
+/* Every tracker known from earlier sessions is streaming again */
+static bool all_streaming;
+
+static void bringup_done(int index, uint32_t now)
+{
+	connection_entry *entry = &connections.entry[index];
+	int streaming = 0;
+
+	entry->state = CM_STATE_STREAMING;
+	entry->state_cycles[CM_STATE_STREAMING] = now;
+
+	for (int i = 0; i < connections.size; i++) {
+		if (connections.entry[i].state == CM_STATE_STREAMING) {
+			streaming++;
+		}
+	}
+
+	printk("Tracker %d first sample after %u ms (connect %u, discovery wait %u, "
+	       "discovery %u, subscribe %u%s), %d streaming (%d known) %u ms after boot\n",
+	       index, cm_state_ms(entry, CM_STATE_CONNECTING, CM_STATE_STREAMING),
+	       cm_state_ms(entry, CM_STATE_CONNECTING, CM_STATE_DISCOVERY_QUEUED),
+	       cm_state_ms(entry, CM_STATE_DISCOVERY_QUEUED, CM_STATE_DISCOVERING),
+	       cm_state_ms(entry, CM_STATE_DISCOVERING, CM_STATE_SUBSCRIBING),
+	       cm_state_ms(entry, CM_STATE_SUBSCRIBING, CM_STATE_STREAMING),
+	       entry->handles_cached ? ", cached handles" : "",
+	       streaming, IS_ENABLED(CONFIG_SLIMEVR_REGISTRY) ? registry_count() : 0,
+	       k_uptime_get_32());
+
+	if (IS_ENABLED(CONFIG_SLIMEVR_REGISTRY) && !all_streaming &&
+	    registry_count() > 0 && streaming >= registry_count()) {
+		all_streaming = true;
+		printk("All %d known trackers streaming %u ms after boot\n",
+		       streaming, k_uptime_get_32());
+	}
+}
 
 static uint8_t on_received(struct bt_conn *conn,
 			struct bt_gatt_subscribe_params *params,
 			const void *data, uint16_t length)
 {
-	int index = cm_get_index_with_conn(&connections, conn);
-	connections.entry[index].debug_counter++;
-	connections.entry[index].debug_data_counter += length;
+	uint32_t now = k_cycle_get_32();
 
-	if(k_uptime_get() <= timer + 1000)
-	{
-		return BT_GATT_ITER_CONTINUE;
+	if (!data) {
+		params->value_handle = 0U;
+		return BT_GATT_ITER_STOP;
 	}
 
-	timer = k_uptime_get();
-	printk("=======================================\n");
-	for(int i = 0; i < connections.size; i++)
-	{
-		if(connections.entry[i].connection == NULL)
-		{
-			continue;
-		}
+	int index = cm_get_index_with_conn(&connections, conn);
+	if (index < 0) {
+		return BT_GATT_ITER_CONTINUE;
+	}
 
-		printk("Messages from (%s): %llu (%llu Bytes)\n", connections.entry[i].addr, connections.entry[i].debug_counter, connections.entry[i].debug_data_counter);
-		connections.entry[i].debug_counter = 0;
-		connections.entry[i].debug_data_counter = 0;
+	if (unlikely(connections.entry[index].state != CM_STATE_STREAMING)) {
+		bringup_done(index, now);
 	}
-	printk("=======================================\n");
 
+	tracker_rx(&connections, index, data, length, now);
 
 	// uint8_t *data_ptr = (uint8_t *) data;
 	// for(int i = 0; i < length; i++)
@@ -208,11 +398,13 @@ int slimevr_handles_get(struct bt_gatt_dm *dm)
 	const struct bt_gatt_chrc *gatt_chrc = 
 		bt_gatt_dm_attr_chrc_val(gatt_chrc_attr);
 	
-	char addr[ADDR_LEN];
-	bt_addr_le_to_str(bt_conn_get_dst(bt_gatt_dm_conn_get(dm)), addr, ADDR_LEN);
-	int index = cm_get_index_with_addr(&connections, addr);
+	int index = cm_get_index_with_conn(&connections, bt_gatt_dm_conn_get(dm));
+	if (index < 0) {
+		return -ENOENT;
+	}
 
-	connections.entry[index].write_params.handle = gatt_chrc->value_handle;
+	connections.entry[index].write_handle = gatt_chrc->value_handle;
+	connections.entry[index].write_props = gatt_chrc->properties;
 
 	// bt_uuid_to_str(gatt_chrc->uuid, uuid_str, sizeof(uuid_str));
 	// printk("CHRC: %s\n", uuid_str);
@@ -225,22 +417,88 @@ struct bt_gatt_subscribe_params sub_params;
 void on_subscribed(struct bt_conn *conn, uint8_t err,
 					 struct bt_gatt_subscribe_params *params)
 {
-	char handshake_part[] = "Hey OVR =D 5";
+	int index = cm_get_index_with_conn(&connections, conn);
+	if (index < 0) {
+		return;
+	}
+
+	connection_entry *entry = &connections.entry[index];
+
+	if (err) {
+		printk("Subscribe failed (err %u)\n", err);
+
+		/* Stale cache, the tracker firmware may have changed */
+		if (IS_ENABLED(CONFIG_SLIMEVR_GATT_CACHE) && entry->handles_cached) {
+			entry->handles_cached = false;
+			handle_cache_remove(&entry->addr);
+			discovery_queue(index);
+		}
+
+		return;
+	}
+
+	if (IS_ENABLED(CONFIG_SLIMEVR_GATT_CACHE) && !entry->handles_cached) {
+		handle_cache_put(&entry->addr, params->value_handle, params->ccc_handle,
+				 entry->write_props);
+	}
+
+	if (IS_ENABLED(CONFIG_SLIMEVR_REGISTRY)) {
+		registry_add(&entry->addr);
+	}
+
+	static const uint8_t handshake[] = "\x03" "Hey OVR =D 5";
+
+	gatt_tx_attach(index, conn, entry->write_handle,
+		       entry->write_props & BT_GATT_CHRC_WRITE_WITHOUT_RESP);
+	gatt_tx_send(index, handshake, sizeof(handshake));
+
+	svr_client_tracker_online(index, true);
+}
+
+/* Subscribes a returning tracker without discovery */
+static int subscribe_cached(int index)
+{
+	connection_entry *entry = &connections.entry[index];
+	uint16_t value_handle;
+	uint16_t ccc_handle;
+	int err;
+
+	err = handle_cache_get(&entry->addr, &value_handle, &ccc_handle,
+			       &entry->write_props);
+	if (err) {
+		return err;
+	}
 
-	char handshake[sizeof(handshake_part) + 1];
+	entry->write_handle = value_handle;
+	entry->sub_params.subscribe = on_subscribed;
+	entry->sub_params.notify = on_received;
+	entry->sub_params.value = BT_GATT_CCC_NOTIFY;
+	entry->sub_params.value_handle = value_handle;
+	entry->sub_params.ccc_handle = ccc_handle;
 
-	handshake[0] = 3;
-	memcpy(handshake + 1, handshake_part, sizeof(handshake_part));
+	err = bt_gatt_subscribe(entry->connection, &entry->sub_params);
+	if (err) {
+		handle_cache_remove(&entry->addr);
+		return err;
+	}
+
+	entry->handles_cached = true;
 
-	slimevr_send(conn, (const uint8_t *)handshake, sizeof(handshake));
+	/* Discovery stages take no time on this path */
+	cm_set_state(entry, CM_STATE_DISCOVERY_QUEUED);
+	cm_set_state(entry, CM_STATE_DISCOVERING);
+	cm_set_state(entry, CM_STATE_SUBSCRIBING);
+
+	return 0;
 }
 
 int slimevr_subscribe(struct bt_gatt_dm *dm)
 {
-	char addr[ADDR_LEN];
-	bt_addr_le_to_str(bt_conn_get_dst(bt_gatt_dm_conn_get(dm)), addr, ADDR_LEN);
-	int index = cm_get_index_with_addr(&connections, addr);
-	
+	int index = cm_get_index_with_conn(&connections, bt_gatt_dm_conn_get(dm));
+	if (index < 0) {
+		return -ENOENT;
+	}
+
 	connections.entry[index].sub_params.subscribe = on_subscribed;
 	connections.entry[index].sub_params.notify = on_received;
 	connections.entry[index].sub_params.value = BT_GATT_CCC_NOTIFY;
@@ -276,40 +534,32 @@ static void discover_all_completed(struct bt_gatt_dm *dm, void *ctx)
 	printk("Found service %s\n", uuid_str);
 	printk("Attribute count: %d\n", attr_count);
 
+	int index = cm_get_index_with_conn(&connections, bt_gatt_dm_conn_get(dm));
+
 	slimevr_handles_get(dm);
-	slimevr_subscribe(dm);
+	if (slimevr_subscribe(dm) == 0 && index >= 0) {
+		cm_set_state(&connections.entry[index], CM_STATE_SUBSCRIBING);
+	}
 	// bt_gatt_dm_data_print(dm);
 	bt_gatt_dm_data_release(dm);
-	bt_gatt_dm_continue(dm, NULL);
-}
-
-void on_write(struct bt_conn *conn, uint8_t err,
-				     struct bt_gatt_write_params *params)
-{
-	printk("Written\n");
-	start_scan();
-}
 
-int slimevr_send(struct bt_conn *conn, const uint8_t *data, uint16_t length)
-{
-	int index = cm_get_index_with_conn(&connections, conn);
-
-	connections.entry[index].write_params.func = on_write;
-	connections.entry[index].write_params.offset = 0;
-	connections.entry[index].write_params.data = data;
-	connections.entry[index].write_params.length = length;
-
-	return bt_gatt_write(conn, &connections.entry[index].write_params);
+	discovery_next();
 }
 
 static void discover_all_service_not_found(struct bt_conn *conn, void *ctx)
 {
 	printk("No more services\n");
+
+	bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+	discovery_next();
 }
 
 static void discover_all_error_found(struct bt_conn *conn, int err, void *ctx)
 {
 	printk("The discovery procedure failed, err %d\n", err);
+
+	bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+	discovery_next();
 }
 
 static struct bt_gatt_dm_cb discover_all_cb = {
@@ -318,6 +568,46 @@ static struct bt_gatt_dm_cb discover_all_cb = {
 	.error_found = discover_all_error_found,
 };
 
+static int discovery_run(int index)
+{
+	connection_entry *entry = &connections.entry[index];
+	int err;
+
+	discovering_index = index;
+	cm_set_state(entry, CM_STATE_DISCOVERING);
+
+	err = bt_gatt_dm_start(entry->connection, UUID_SLIME_VR, &discover_all_cb, NULL);
+	if (err) {
+		printk("Failed to start discovery (err %d)\n", err);
+		discovering_index = -1;
+		bt_conn_disconnect(entry->connection, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+	}
+
+	return err;
+}
+
+static void discovery_queue(int index)
+{
+	cm_set_state(&connections.entry[index], CM_STATE_DISCOVERY_QUEUED);
+
+	if (discovering_index < 0) {
+		discovery_run(index);
+	}
+}
+
+/* The previous discovery is over, start the longest waiting one */
+static void discovery_next(void)
+{
+	discovering_index = -1;
+
+	for (int i = 0; i < connections.size; i++) {
+		if (connections.entry[i].state == CM_STATE_DISCOVERY_QUEUED &&
+		    discovery_run(i) == 0) {
+			return;
+		}
+	}
+}
+
 void mtu_exchange_func(struct bt_conn *conn, uint8_t err,
 		     struct bt_gatt_exchange_params *params)
 {
@@ -326,51 +616,65 @@ void mtu_exchange_func(struct bt_conn *conn, uint8_t err,
 	printk("MTU: %u\n", bt_gatt_get_mtu(conn));
 }
 
-struct bt_gatt_exchange_params exchange_params = {
-		.func = mtu_exchange_func
-};
-
-struct bt_le_conn_param conn_param = {
-	.interval_max = 6,
-	.interval_min = 6,
-	.latency = 0,
-	.timeout = 10
-};
-
 static void connected(struct bt_conn *conn, uint8_t err)
 {
 	char addr[BT_ADDR_LE_STR_LEN];
+	int index = cm_get_index_with_conn(&connections, conn);
+
+#if defined(CONFIG_SLIMEVR_REGISTRY)
+	/*
+	 * Every other link is bound when it is created, so an unknown one
+	 * came from the accept list. It may complete just as the timeout
+	 * stopped auto-connect, so autoconnect_active is not checked.
+	 */
+	if (index < 0 && !err && is_central(conn)) {
+		index = autoconnect_bind(conn);
+		if (index < 0) {
+			bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+			return;
+		}
+	}
+#endif
+
+	if (index < 0) {
+		return;
+	}
+
+	if (index == connecting_index) {
+		connecting_index = -1;
+	}
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
 	if (err) {
 		printk("Failed to connect to %s (%u)\n", addr, err);
 
-		bt_conn_unref(connections.entry[current_connection_index].connection);
-		connections.entry[current_connection_index].connection = NULL;
-
-		start_scan();
-		return;
-	}
+		cm_remove_object_with_index(&connections, index);
+		bt_conn_unref(conn);
 
-	if (conn != connections.entry[current_connection_index].connection) {
+		resume_connecting();
 		return;
 	}
 
 	printk("Connected: %s\n", addr);
 
-	bt_gatt_exchange_mtu(conn, &exchange_params);
+	/* The controller is free to initiate the next link already */
+	resume_connecting();
 
-	printk("Updated phy?: %d\n", bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M));
+	connections.entry[index].exchange_params.func = mtu_exchange_func;
+	bt_gatt_exchange_mtu(conn, &connections.entry[index].exchange_params);
 
-	printk("Updated params?: %d\n", bt_conn_le_param_update(conn, &conn_param));
+	printk("Updated phy?: %d\n", bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M));
 
 	printk("Updated len?: %d\n", bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX));
 
-	err = bt_gatt_dm_start(conn, UUID_SLIME_VR, &discover_all_cb, NULL);
-	if (err) {
-		printk("Failed to start discovery (err %d)\n", err);
+	connections.entry[index].handles_cached = false;
+
+	if (IS_ENABLED(CONFIG_SLIMEVR_GATT_CACHE) && subscribe_cached(index) == 0) {
+		return;
 	}
+
+	discovery_queue(index);
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
@@ -379,18 +683,24 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
-	int index = cm_get_index_with_addr(&connections, addr);
+	int index = cm_get_index_with_conn(&connections, conn);
 
-	if (conn != connections.entry[index].connection) {
+	if (index < 0) {
 		return;
 	}
 
 	printk("Disconnected: %s (reason 0x%02x)\n", addr, reason);
 
-	bt_conn_unref(connections.entry[index].connection);
-	connections.entry[index].connection = NULL;
+	svr_client_tracker_online(index, false);
+	gatt_tx_detach(index);
+	if (IS_ENABLED(CONFIG_SLIMEVR_TIME_SYNC)) {
+		time_sync_reset(index);
+	}
 
-	start_scan();
+	cm_remove_object_with_index(&connections, index);
+	bt_conn_unref(conn);
+
+	resume_connecting();
 }
 
 struct bt_conn_cb conn_callbacks = {
@@ -398,20 +708,9 @@ struct bt_conn_cb conn_callbacks = {
 	.disconnected = disconnected,
 };
 
-struct bt_scan_init_param scan_init = {
-		.connect_if_match = 0,
-		.scan_param = BT_LE_SCAN_ACTIVE,
-		.conn_param = BT_LE_CONN_PARAM_DEFAULT
-	};
-
-
-#include <zephyr/kernel.h>
-#include <zephyr/sys/printk.h>
-#include <zephyr/usb/usb_device.h>
-#include <zephyr/usb/usbd.h>
-#include <zephyr/drivers/uart.h>
-#include <zephyr/logging/log.h>
 
+/* The network half is left out of the BabbleSim build, see tests/bsim */
+#if defined(CONFIG_NETWORKING)
 #include <zephyr/net/net_if.h>
 #include <zephyr/net/net_core.h>
 #include <zephyr/net/net_context.h>
@@ -513,17 +812,44 @@ static void option_handler(struct net_dhcpv4_option_callback *cb,
 		net_addr_ntop(AF_INET, cb->data, buf, sizeof(buf)));
 }
 
+/* Brings up USB and the network, then serves it until it quits */
+static void echo_server_thread(void)
+{
+	start_echo_server();
+}
+
+K_THREAD_DEFINE(echo_server_thread_id, CONFIG_SLIMEVR_NET_STACK_SIZE,
+		echo_server_thread, NULL, NULL, NULL, K_PRIO_PREEMPT(7), 0,
+		SYS_FOREVER_MS);
+#endif /* CONFIG_NETWORKING */
+
+#if defined(CONFIG_USB_CDC_ACM)
 BUILD_ASSERT(DT_NODE_HAS_COMPAT(DT_CHOSEN(zephyr_console), zephyr_cdc_acm_uart),
 	     "Console device is not ACM CDC UART device");
+#endif
 
+#if DT_NODE_EXISTS(DT_ALIAS(led0))
 static const struct gpio_dt_spec led = GPIO_DT_SPEC_GET(DT_ALIAS(led0), gpios);
+#endif
 
 int main(void)
 {
 	int err;
 
-	start_echo_server();
+	ram_budget_report();
+	stats_start(&connections);
+	liveness_start(&connections);
+	conn_sched_start(&connections);
+	if (IS_ENABLED(CONFIG_SLIMEVR_TIME_SYNC)) {
+		time_sync_start(&connections);
+	}
+
+#if defined(CONFIG_NETWORKING)
+	/* start_echo_server() blocks while the network is up */
+	k_thread_start(echo_server_thread_id);
+#endif
 
+#if DT_NODE_EXISTS(DT_ALIAS(led0))
 	if (!gpio_is_ready_dt(&led)) {
 		// return 0;
 	}
@@ -532,14 +858,9 @@ int main(void)
 	if (err < 0) {
 		// return 0;
 	}
+#endif
 
-	const struct device *const dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
-	uint32_t dtr = 0;
-
-	if (usb_enable(NULL)) {
-		return 0;
-	}
-
+#if defined(CONFIG_NETWORKING)
 	net_mgmt_init_event_callback(&mgmt_cb, handler,
 				     NET_EVENT_IPV4_ADDR_ADD);
 	net_mgmt_add_event_callback(&mgmt_cb);
@@ -551,25 +872,11 @@ int main(void)
 	net_dhcpv4_add_option_callback(&dhcp_cb);
 
 	net_if_foreach(start_dhcpv4_client, NULL);
+#endif
 
+#if DT_NODE_EXISTS(DT_ALIAS(led0))
 	gpio_pin_set_dt(&led, 1);
-	
-
-	while(true)
-	{
-		LOG_ERR("HI");
-		k_msleep(500);
-	}
-
-	return 0;
-
-	// Don't know why this is enabled, but it stops device from working sometimes
-	/* Poll if the DTR flag was set */
-	while (!dtr) {
-		uart_line_ctrl_get(dev, UART_LINE_CTRL_DTR, &dtr);
-		/* Give CPU resources to low priority threads. */
-		k_sleep(K_MSEC(100));
-	}
+#endif
 
 	err = bt_enable(NULL);
 	if (err) {
@@ -579,17 +886,16 @@ int main(void)
 
 	bt_conn_cb_register(&conn_callbacks);
 
-	printk("Bluetooth initialized\n");
-	k_msleep(1000);
-
-	bt_scan_init(&scan_init);
-	bt_scan_cb_register(&scan_cb);
+	if (IS_ENABLED(CONFIG_SETTINGS)) {
+		settings_load();
+	}
 
-	bt_scan_filter_add(BT_SCAN_FILTER_TYPE_UUID, UUID_SLIME_VR);
+	printk("Bluetooth initialized\n");
 
-	bt_scan_filter_enable(BT_SCAN_UUID_FILTER, false);
+	adv_filter_init();
+	bt_le_scan_cb_register(&scan_cb);
 
-	start_scan();
+	resume_connecting();
 
 	// while(true)
 	// {
@@ -0,0 +1,40 @@
+/* ram_budget.c - Boot time report of RAM spent on tracker state */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(ram_budget, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/linker/linker-defs.h>
+
+#include "ram_budget.h"
+
+#if defined(CONFIG_BT)
+BUILD_ASSERT(CONFIG_SLIMEVR_MAX_TRACKERS <= CONFIG_BT_MAX_CONN,
+	     "Every tracker needs a Bluetooth connection");
+#endif
+
+void ram_budget_report(void)
+{
+	size_t per_tracker = 0;
+	size_t shared = 0;
+
+	STRUCT_SECTION_FOREACH(ram_budget, b) {
+		LOG_INF("%-10s %5zu B/tracker, %5zu B shared", b->name,
+			b->per_tracker, b->shared);
+		per_tracker += b->per_tracker;
+		shared += b->shared;
+	}
+
+	LOG_INF("%d trackers: %zu B/tracker, %zu B in total",
+		CONFIG_SLIMEVR_MAX_TRACKERS, per_tracker,
+		per_tracker * CONFIG_SLIMEVR_MAX_TRACKERS + shared);
+
+#if !defined(CONFIG_ARCH_POSIX) && DT_HAS_CHOSEN(zephyr_sram)
+	size_t image = (size_t)(_image_ram_end - _image_ram_start);
+
+	/* Includes stacks, network and Bluetooth pools */
+	LOG_INF("Static RAM %zu of %zu B, %zu B left, %d B reserved for pools",
+		image, RAM_BUDGET_SRAM, RAM_BUDGET_SRAM - image,
+		CONFIG_SLIMEVR_RAM_RESERVE);
+#endif
+}
@@ -0,0 +1,328 @@
+/* slimevr_client.c - SlimeVR server session on the forwarding socket */
+
+/*
+ * Until a server answers, a handshake is sent every second to
+ * CONFIG_SLIMEVR_SERVER_ADDR, or broadcast when that is empty. The
+ * answering server, which has to be the configured one if there is one,
+ * becomes the forwarding peer, gets a sensor info
+ * packet for every connected tracker and is dropped again when it has
+ * been silent for SVR_TIMEOUT_MS. Everything goes over the one socket
+ * the UDP service opened, whatever the number of trackers.
+ *
+ * Server packets meant for sensors are queued for the matching tracker
+ * slots right from the UDP thread. Queueing never blocks, so neither
+ * that thread nor the forwarder ever waits on a tracker.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(slimevr_client, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/math_extras.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/net/net_if.h>
+#include <string.h>
+#include <errno.h>
+
+#include "forwarder.h"
+#include "gatt_tx.h"
+#include "slimevr_client.h"
+#include "slimevr_proto.h"
+
+#define SVR_HANDSHAKE_INTERVAL K_SECONDS(1)
+#define SVR_TIMEOUT_MS 3000
+
+static atomic_t client_sock = ATOMIC_INIT(-1);
+static atomic_t connected;
+static atomic_t last_rx;
+/* One bit per tracker slot */
+static atomic_t online_mask;
+static atomic_t announced_mask;
+
+static atomic_t dl_packets;
+static atomic_t dl_queued;
+static atomic_t dl_unknown;
+static atomic_t dl_overflow;
+
+static struct k_spinlock server_lock;
+static struct sockaddr_in server;
+
+static void client_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(client_work, client_work_handler);
+
+static void send_handshake(int sock)
+{
+	uint8_t buf[SVR_HANDSHAKE_MAX_LEN];
+	uint8_t mac[6] = {0};
+	struct net_linkaddr *link;
+	struct sockaddr_in dst = {
+		.sin_family = AF_INET,
+		.sin_port = htons(CONFIG_SLIMEVR_SERVER_PORT),
+		.sin_addr.s_addr = INADDR_BROADCAST,
+	};
+	size_t len;
+
+	if (CONFIG_SLIMEVR_SERVER_ADDR[0] != '\0' &&
+	    inet_pton(AF_INET, CONFIG_SLIMEVR_SERVER_ADDR, &dst.sin_addr) != 1) {
+		LOG_ERR("Invalid server address %s", CONFIG_SLIMEVR_SERVER_ADDR);
+		return;
+	}
+
+	link = net_if_get_link_addr(net_if_get_default());
+	if (link != NULL && link->len == sizeof(mac)) {
+		memcpy(mac, link->addr, sizeof(mac));
+	}
+
+	len = svr_encode_handshake(buf, mac);
+
+	if (sendto(sock, buf, len, 0, (struct sockaddr *)&dst,
+		   sizeof(dst)) < 0) {
+		LOG_DBG("Handshake failed %d", errno);
+	}
+}
+
+static void announce_sensors(int sock)
+{
+	uint32_t online = atomic_get(&online_mask);
+	uint32_t changed = online ^ (uint32_t)atomic_set(&announced_mask, online);
+	uint8_t buf[SVR_SENSOR_INFO_LEN];
+	struct sockaddr_in dst;
+	k_spinlock_key_t key;
+	size_t len;
+
+	key = k_spin_lock(&server_lock);
+	dst = server;
+	k_spin_unlock(&server_lock, key);
+
+	while (changed) {
+		uint8_t tracker = u32_count_trailing_zeros(changed);
+
+		changed &= ~BIT(tracker);
+
+		len = svr_encode_sensor_info(buf, tracker,
+					     (online & BIT(tracker)) ?
+					     SVR_SENSOR_OK : SVR_SENSOR_OFFLINE);
+		(void)sendto(sock, buf, len, 0, (struct sockaddr *)&dst,
+			     sizeof(dst));
+	}
+}
+
+static void client_work_handler(struct k_work *work)
+{
+	int sock = atomic_get(&client_sock);
+
+	if (sock < 0) {
+		return;
+	}
+
+	if (atomic_get(&connected) &&
+	    k_uptime_get_32() - (uint32_t)atomic_get(&last_rx) > SVR_TIMEOUT_MS) {
+		LOG_WRN("Server timed out");
+		atomic_clear(&connected);
+		fwd_clear_peer();
+	}
+
+	if (atomic_get(&connected)) {
+		announce_sensors(sock);
+	} else {
+		send_handshake(sock);
+	}
+
+	k_work_reschedule(&client_work, SVR_HANDSHAKE_INTERVAL);
+}
+
+static bool from_server(const struct sockaddr *from)
+{
+	const struct sockaddr_in *addr = (const struct sockaddr_in *)from;
+	k_spinlock_key_t key;
+	bool match;
+
+	key = k_spin_lock(&server_lock);
+	match = addr->sin_addr.s_addr == server.sin_addr.s_addr &&
+		addr->sin_port == server.sin_port;
+	k_spin_unlock(&server_lock, key);
+
+	return match;
+}
+
+/* With a configured server, no other host on the LAN can take over */
+static bool server_allowed(const struct sockaddr *from)
+{
+	const struct sockaddr_in *addr = (const struct sockaddr_in *)from;
+	struct in_addr configured;
+
+	if (CONFIG_SLIMEVR_SERVER_ADDR[0] == '\0') {
+		return true;
+	}
+
+	return inet_pton(AF_INET, CONFIG_SLIMEVR_SERVER_ADDR, &configured) == 1 &&
+	       addr->sin_addr.s_addr == configured.s_addr;
+}
+
+static void handle_handshake(const struct sockaddr *from, socklen_t fromlen)
+{
+	char addr[NET_IPV4_ADDR_LEN];
+	k_spinlock_key_t key;
+
+	if (!server_allowed(from)) {
+		return;
+	}
+
+	key = k_spin_lock(&server_lock);
+	memcpy(&server, from, sizeof(server));
+	k_spin_unlock(&server_lock, key);
+
+	atomic_set(&last_rx, k_uptime_get_32());
+	fwd_set_peer(from, fromlen);
+
+	if (atomic_set(&connected, 1)) {
+		return;
+	}
+
+	LOG_INF("Connected to server %s",
+		inet_ntop(AF_INET, &server.sin_addr, addr, sizeof(addr)));
+
+	/* Announce every tracker again */
+	atomic_clear(&announced_mask);
+	k_work_reschedule(&client_work, K_NO_WAIT);
+}
+
+static void route_downlink(const uint8_t *buf, size_t len)
+{
+	uint8_t cmd[CONFIG_SLIMEVR_GATT_TX_CMD_SIZE];
+	uint32_t online = atomic_get(&online_mask);
+	uint32_t targets;
+	int sensor;
+	int err;
+
+	if (len > sizeof(cmd)) {
+		atomic_inc(&dl_overflow);
+		return;
+	}
+
+	memcpy(cmd, buf, len);
+
+	sensor = svr_downlink_sensor(cmd, len);
+	if (sensor < 0) {
+		return;
+	}
+
+	atomic_inc(&dl_packets);
+
+	if (sensor == SVR_SENSOR_ALL) {
+		targets = online;
+	} else if (sensor < 32 && (online & BIT(sensor))) {
+		targets = BIT(sensor);
+	} else {
+		atomic_inc(&dl_unknown);
+		return;
+	}
+
+	while (targets) {
+		uint8_t tracker = u32_count_trailing_zeros(targets);
+
+		targets &= ~BIT(tracker);
+
+		err = gatt_tx_send(tracker, cmd, len);
+		if (err == 0) {
+			atomic_inc(&dl_queued);
+		} else if (err == -ENOMEM || err == -ENOBUFS) {
+			atomic_inc(&dl_overflow);
+		} else {
+			atomic_inc(&dl_unknown);
+		}
+	}
+}
+
+void svr_client_recv(int sock, const uint8_t *buf, size_t len,
+		     const struct sockaddr *from, socklen_t fromlen)
+{
+	uint8_t reply[SVR_HEADER_LEN + sizeof(uint32_t)];
+	size_t reply_len;
+
+	if (from->sa_family != AF_INET || fromlen < sizeof(struct sockaddr_in)) {
+		return;
+	}
+
+	if (len > sizeof(SVR_HANDSHAKE_REPLY) &&
+	    buf[0] == SVR_PACKET_RECEIVE_HANDSHAKE &&
+	    memcmp(&buf[1], SVR_HANDSHAKE_REPLY,
+		   sizeof(SVR_HANDSHAKE_REPLY) - 1) == 0) {
+		handle_handshake(from, fromlen);
+		return;
+	}
+
+	if (!atomic_get(&connected) || len < SVR_HEADER_LEN ||
+	    !from_server(from)) {
+		return;
+	}
+
+	atomic_set(&last_rx, k_uptime_get_32());
+
+	switch (sys_get_be32(buf)) {
+	case SVR_PACKET_RECEIVE_HEARTBEAT:
+		reply_len = svr_encode_heartbeat(reply);
+		break;
+	case SVR_PACKET_PING_PONG:
+		if (len < sizeof(reply)) {
+			return;
+		}
+
+		reply_len = svr_encode_header(reply, SVR_PACKET_PING_PONG);
+		memcpy(&reply[reply_len], &buf[SVR_HEADER_LEN], sizeof(uint32_t));
+		reply_len += sizeof(uint32_t);
+		break;
+	default:
+		route_downlink(buf, len);
+		return;
+	}
+
+	(void)sendto(sock, reply, reply_len, 0, from, fromlen);
+}
+
+void svr_client_tracker_online(uint8_t tracker, bool online)
+{
+	if (tracker >= 32) {
+		return;
+	}
+
+	if (online) {
+		atomic_or(&online_mask, BIT(tracker));
+	} else {
+		atomic_and(&online_mask, ~BIT(tracker));
+	}
+
+	if (atomic_get(&connected)) {
+		k_work_reschedule(&client_work, K_NO_WAIT);
+	}
+}
+
+bool svr_client_is_connected(void)
+{
+	return atomic_get(&connected);
+}
+
+void svr_client_get_stats(struct svr_client_stats *stats)
+{
+	stats->downlink = atomic_get(&dl_packets);
+	stats->queued = atomic_get(&dl_queued);
+	stats->unknown_tracker = atomic_get(&dl_unknown);
+	stats->overflow = atomic_get(&dl_overflow);
+}
+
+void svr_client_attach_socket(int sock)
+{
+	atomic_set(&client_sock, sock);
+	k_work_reschedule(&client_work, K_NO_WAIT);
+}
+
+void svr_client_detach_socket(void)
+{
+	atomic_set(&client_sock, -1);
+	atomic_clear(&connected);
+	fwd_clear_peer();
+	k_work_cancel_delayable(&client_work);
+}
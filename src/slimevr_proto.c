@@ -0,0 +1,220 @@
+/* slimevr_proto.c - SlimeVR server protocol encoder */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <errno.h>
+#include <string.h>
+
+#include "slimevr_proto.h"
+
+#define SVR_BOARD_CUSTOM 4
+#define SVR_MCU_UNKNOWN 0
+#define SVR_IMU_UNKNOWN 0
+#define SVR_FIRMWARE_BUILD 1
+#define SVR_FIRMWARE_VERSION "nrf-receiver"
+
+/* Shared by every thread that sends, wraps after 2^32 packets */
+static atomic_t packet_number;
+
+static inline uint8_t *put_float(uint8_t *buf, float value)
+{
+	uint32_t raw;
+
+	memcpy(&raw, &value, sizeof(raw));
+	sys_put_be32(raw, buf);
+
+	return buf + sizeof(raw);
+}
+
+size_t svr_encode_header(uint8_t *buf, uint32_t type)
+{
+	sys_put_be32(type, buf);
+	sys_put_be64((uint32_t)atomic_inc(&packet_number), buf + SVR_TYPE_LEN);
+
+	return SVR_HEADER_LEN;
+}
+
+size_t svr_encode_handshake(uint8_t *buf, const uint8_t mac[6])
+{
+	uint8_t *p = buf;
+
+	sys_put_be32(SVR_PACKET_HANDSHAKE, p);
+	/* Handshakes always carry packet number 0 */
+	sys_put_be64(0, p + SVR_TYPE_LEN);
+	p += SVR_HEADER_LEN;
+
+	sys_put_be32(SVR_BOARD_CUSTOM, p);
+	sys_put_be32(SVR_IMU_UNKNOWN, p + 4);
+	sys_put_be32(SVR_MCU_UNKNOWN, p + 8);
+	/* IMU info, unused */
+	memset(p + 12, 0, 12);
+	sys_put_be32(SVR_FIRMWARE_BUILD, p + 24);
+	p += 28;
+
+	*p++ = sizeof(SVR_FIRMWARE_VERSION) - 1;
+	memcpy(p, SVR_FIRMWARE_VERSION, sizeof(SVR_FIRMWARE_VERSION) - 1);
+	p += sizeof(SVR_FIRMWARE_VERSION) - 1;
+
+	memcpy(p, mac, 6);
+	p += 6;
+
+	return p - buf;
+}
+
+BUILD_ASSERT(SVR_HEADER_LEN + 28 + 1 + sizeof(SVR_FIRMWARE_VERSION) - 1 + 6 <=
+	     SVR_HANDSHAKE_MAX_LEN);
+
+size_t svr_encode_heartbeat(uint8_t *buf)
+{
+	return svr_encode_header(buf, SVR_PACKET_HEARTBEAT);
+}
+
+size_t svr_encode_sensor_info(uint8_t *buf, uint8_t sensor_id, uint8_t state)
+{
+	uint8_t *p = buf + svr_encode_header(buf, SVR_PACKET_SENSOR_INFO);
+
+	p[0] = sensor_id;
+	p[1] = state;
+	p[2] = SVR_IMU_UNKNOWN;
+
+	return SVR_SENSOR_INFO_LEN;
+}
+
+size_t svr_encode_rotation(uint8_t *buf, uint8_t sensor_id,
+			   const float quat[4], uint8_t accuracy)
+{
+	uint8_t *p = buf + svr_encode_header(buf, SVR_PACKET_ROTATION_DATA);
+
+	*p++ = sensor_id;
+	*p++ = SVR_ROTATION_DATA_NORMAL;
+	for (int i = 0; i < 4; i++) {
+		p = put_float(p, quat[i]);
+	}
+	*p = accuracy;
+
+	return SVR_ROTATION_LEN;
+}
+
+size_t svr_encode_accel(uint8_t *buf, uint8_t sensor_id, const float accel[3])
+{
+	uint8_t *p = buf + svr_encode_header(buf, SVR_PACKET_ACCEL);
+
+	for (int i = 0; i < 3; i++) {
+		p = put_float(p, accel[i]);
+	}
+	*p = sensor_id;
+
+	return SVR_ACCEL_LEN;
+}
+
+size_t svr_encode_battery(uint8_t *buf, float voltage, float level)
+{
+	uint8_t *p = buf + svr_encode_header(buf, SVR_PACKET_BATTERY_LEVEL);
+
+	p = put_float(p, voltage);
+	put_float(p, level);
+
+	return SVR_BATTERY_LEN;
+}
+
+size_t svr_encode_time_sync(uint8_t *buf, uint8_t seq, uint32_t receiver_us)
+{
+	uint8_t *p = buf + svr_encode_header(buf, SVR_PACKET_TIME_SYNC);
+
+	p[0] = seq;
+	sys_put_be32(receiver_us, p + 1);
+
+	return SVR_TIME_SYNC_LEN;
+}
+
+int svr_bundle_record(uint8_t sensor_id, uint8_t *pkt, size_t len,
+		      uint8_t **record)
+{
+	uint8_t *body = pkt + SVR_HEADER_LEN;
+	size_t body_len;
+	uint32_t type;
+	uint8_t *rec;
+
+	if (len < SVR_HEADER_LEN) {
+		return -EINVAL;
+	}
+
+	body_len = len - SVR_HEADER_LEN;
+	type = sys_get_be32(pkt);
+
+	switch (type) {
+	case SVR_PACKET_ROTATION_DATA:
+	case SVR_PACKET_SENSOR_INFO:
+		if (body_len >= 1) {
+			body[0] = sensor_id;
+		}
+		break;
+	case SVR_PACKET_ACCEL:
+		if (body_len >= 13) {
+			body[12] = sensor_id;
+		}
+		break;
+	default:
+		break;
+	}
+
+	/* [len][type] go where the packet number was */
+	rec = body - SVR_TYPE_LEN - SVR_RECORD_HDR_LEN;
+	sys_put_be32(type, body - SVR_TYPE_LEN);
+	sys_put_be16(SVR_TYPE_LEN + body_len, rec);
+
+	*record = rec;
+
+	return SVR_RECORD_HDR_LEN + SVR_TYPE_LEN + body_len;
+}
+
+size_t svr_encode_frame_ages(uint8_t *buf, const uint8_t *sensor_id,
+			     const uint32_t *age_us, size_t count)
+{
+	uint8_t *p = buf + SVR_RECORD_HDR_LEN;
+
+	sys_put_be32(SVR_PACKET_FRAME_AGES, p);
+	p += SVR_TYPE_LEN;
+	*p++ = count;
+
+	for (size_t i = 0; i < count; i++) {
+		*p++ = sensor_id[i];
+		sys_put_be16(MIN(age_us[i], UINT16_MAX), p);
+		p += sizeof(uint16_t);
+	}
+
+	sys_put_be16(p - buf - SVR_RECORD_HDR_LEN, buf);
+
+	return p - buf;
+}
+
+int svr_downlink_sensor(uint8_t *pkt, size_t len)
+{
+	uint8_t *body = pkt + SVR_HEADER_LEN;
+	int sensor;
+
+	if (len < SVR_HEADER_LEN) {
+		return -EINVAL;
+	}
+
+	switch (sys_get_be32(pkt)) {
+	case SVR_PACKET_RECEIVE_VIBRATE:
+	case SVR_PACKET_RECEIVE_COMMAND:
+	case SVR_PACKET_FEATURE_FLAGS:
+		return SVR_SENSOR_ALL;
+	case SVR_PACKET_SET_CONFIG_FLAG:
+		if (len < SVR_HEADER_LEN + 1) {
+			return -EINVAL;
+		}
+
+		sensor = body[0];
+		if (sensor != SVR_SENSOR_ALL) {
+			body[0] = 0;
+		}
+
+		return sensor;
+	default:
+		return -ENOTSUP;
+	}
+}
@@ -0,0 +1,250 @@
+/* stats.c - Periodic receiver statistics on a low priority work queue */
+
+/*
+ * The notification path only bumps counters in its slot's connection_rx
+ * record. A delayable work item on a dedicated lowest-priority queue reads
+ * them through the record's seqlock, turns them into per-second rates and
+ * logs them together with the forwarder and latency statistics.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(stats, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/addr.h>
+#include <errno.h>
+
+#include "adv_filter.h"
+#include "forwarder.h"
+#include "gatt_tx.h"
+#include "slimevr_client.h"
+#include "latency.h"
+#include "ram_budget.h"
+#include "stats.h"
+#include "time_sync.h"
+
+K_THREAD_STACK_DEFINE(stats_stack, CONFIG_SLIMEVR_STATS_STACK_SIZE);
+static struct k_work_q stats_wq;
+static struct k_work_delayable stats_print;
+
+static connection_map *connections;
+static connection_counters last[STATS_TRACKERS];
+static uint32_t last_cycles;
+
+/* Readers use rates[rates_index], the worker fills the other half */
+static struct tracker_rates rates[2][STATS_TRACKERS];
+static atomic_t rates_index;
+
+RAM_BUDGET_DEFINE(stats,
+		  sizeof(connection_counters) + 2 * sizeof(struct tracker_rates),
+		  CONFIG_SLIMEVR_STATS_STACK_SIZE);
+
+/* Sum over every interval since the number of active trackers changed */
+static int sustained_trackers;
+static uint64_t sustained_packets;
+static uint32_t sustained_ms;
+static uint32_t peak_packets_per_sec;
+
+static struct fwd_stats last_fwd;
+static struct adv_filter_stats last_scan;
+
+int stats_get_tracker(uint8_t tracker, struct tracker_rates *out)
+{
+	if (tracker >= STATS_TRACKERS) {
+		return -EINVAL;
+	}
+
+	*out = rates[atomic_get(&rates_index)][tracker];
+
+	return 0;
+}
+
+static void update_trackers(uint32_t elapsed_ms)
+{
+	int next = !atomic_get(&rates_index);
+	int count = MIN(connections->size, STATS_TRACKERS);
+	uint32_t total_packets = 0;
+	uint32_t total_bytes = 0;
+	int active = 0;
+
+	for (int i = 0; i < count; i++) {
+		connection_entry *entry = &connections->entry[i];
+		struct tracker_rates *r = &rates[next][i];
+		char addr[BT_ADDR_LE_STR_LEN];
+		struct gatt_tx_stats tx;
+		struct time_sync_info sync;
+		connection_counters now;
+
+		cm_read_counters(connections, i, &now);
+
+		/* Synthetic trackers stream without a connection */
+		r->active = entry->connection != NULL ||
+			    entry->state == CM_STATE_STREAMING;
+		r->packets_per_sec = (now.packets - last[i].packets) * 1000U / elapsed_ms;
+		r->bytes_per_sec = (now.bytes - last[i].bytes) * 1000U / elapsed_ms;
+		r->gaps = now.gaps - last[i].gaps;
+		r->gap_ms = r->gaps ? k_cyc_to_ms_floor32(now.gap_cycles - last[i].gap_cycles) /
+				      r->gaps : 0;
+		r->gap_max_ms = k_cyc_to_ms_floor32(now.gap_max_cycles);
+		r->stalls = entry->stalls;
+		last[i] = now;
+
+		if (!r->active) {
+			continue;
+		}
+
+		active++;
+		total_packets += r->packets_per_sec;
+		total_bytes += r->bytes_per_sec;
+
+		bt_addr_le_to_str(&entry->addr, addr, sizeof(addr));
+		LOG_INF("Tracker %d (%s): %u pkt/s, %u B/s, %u gaps (mean %u ms, "
+			"max %u ms), %u stalls, %u overwritten", i, addr,
+			r->packets_per_sec, r->bytes_per_sec, r->gaps, r->gap_ms,
+			r->gap_max_ms, r->stalls, fwd_get_overwrites(i));
+
+		if (gatt_tx_get_stats(i, &tx) == 0 && tx.queued != 0) {
+			LOG_INF("Tracker %d commands %u queued, %u sent, %u done, "
+				"%u errors, %u no buffer, %u full, %u expired, "
+				"%u pending", i, tx.queued, tx.sent, tx.completed,
+				tx.errors, tx.no_buffer, tx.queue_full, tx.expired,
+				tx.pending);
+		}
+
+		if (IS_ENABLED(CONFIG_SLIMEVR_TIME_SYNC) &&
+		    time_sync_get(i, &sync) == 0 && sync.synced) {
+			LOG_INF("Tracker %d clock offset %d us, drift %d ppb, "
+				"rtt %u us, %u exchanges, %u rejected", i,
+				sync.offset_us, sync.drift_ppb, sync.rtt_us,
+				sync.exchanges, sync.rejected);
+		}
+	}
+
+	atomic_set(&rates_index, next);
+
+	if (active != sustained_trackers) {
+		sustained_trackers = active;
+		sustained_packets = 0;
+		sustained_ms = 0;
+		peak_packets_per_sec = 0;
+	}
+
+	if (active == 0) {
+		return;
+	}
+
+	sustained_packets += (uint64_t)total_packets * elapsed_ms;
+	sustained_ms += elapsed_ms;
+	peak_packets_per_sec = MAX(peak_packets_per_sec, total_packets);
+
+	LOG_INF("%d trackers: %u pkt/s, %u B/s, sustained %u pkt/s over %u s "
+		"(peak %u)", active, total_packets, total_bytes,
+		(uint32_t)(sustained_packets / sustained_ms),
+		sustained_ms / MSEC_PER_SEC, peak_packets_per_sec);
+}
+
+static void update_forwarder(uint32_t elapsed_ms)
+{
+	struct fwd_stats s;
+	uint32_t datagrams;
+	uint32_t frames;
+	uint32_t bytes;
+
+	fwd_get_stats(&s);
+
+	datagrams = s.datagrams - last_fwd.datagrams;
+	frames = s.frames - last_fwd.frames;
+	bytes = s.datagram_bytes - last_fwd.datagram_bytes;
+	last_fwd = s;
+
+	LOG_INF("Forwarded %u/%u, dropped full %u size %u no peer %u, "
+		"errors %u, ring %u/%d (max %u)",
+		s.sent, s.submitted, s.dropped_full, s.dropped_size,
+		s.dropped_no_peer, s.send_errors, s.occupancy,
+		CONFIG_SLIMEVR_FWD_RING_SIZE, s.high_water);
+	LOG_INF("Bulk %u sent, dropped full %u, ring %u/%d (max %u), "
+		"%u starved", s.bulk_sent, s.bulk_dropped_full, s.bulk_occupancy,
+		CONFIG_SLIMEVR_FWD_BULK_RING_SIZE, s.bulk_high_water,
+		s.bulk_starved);
+	LOG_INF("%u datagrams/sec, %u B/datagram",
+		datagrams * 1000U / elapsed_ms,
+		datagrams ? bytes / datagrams : 0);
+	if (IS_ENABLED(CONFIG_SLIMEVR_FWD_FRAMES)) {
+		LOG_INF("%u frames/sec, %u repeated samples",
+			frames * 1000U / elapsed_ms, s.frame_repeated);
+	}
+
+	for (int i = 0; i < LATENCY_TRACKERS; i++) {
+		struct latency_summary lat;
+
+		if (latency_get(i, &lat) || lat.count == 0) {
+			continue;
+		}
+
+		LOG_INF("Tracker %d latency p50 %u us, p99 %u us, max %u us "
+			"(%u samples)", i, lat.p50_us, lat.p99_us, lat.max_us,
+			lat.count);
+		latency_reset(i);
+	}
+}
+
+static void update_downlink(void)
+{
+	struct svr_client_stats s;
+
+	svr_client_get_stats(&s);
+
+	if (s.downlink != 0) {
+		LOG_INF("Server packets to trackers %u, queued %u, unknown tracker %u, "
+			"overflow %u", s.downlink, s.queued, s.unknown_tracker,
+			s.overflow);
+	}
+}
+
+static void update_scan(uint32_t elapsed_ms)
+{
+	struct adv_filter_stats s;
+
+	adv_filter_get_stats(&s);
+
+	if (s.scanned != last_scan.scanned) {
+		LOG_INF("Scan %u adverts/s, %u matched, %u rejected",
+			(s.scanned - last_scan.scanned) * 1000U / elapsed_ms,
+			(s.matched - last_scan.matched) * 1000U / elapsed_ms,
+			(s.rejected - last_scan.rejected) * 1000U / elapsed_ms);
+	}
+
+	last_scan = s;
+}
+
+static void print_stats(struct k_work *work)
+{
+	uint32_t now = k_cycle_get_32();
+	uint32_t elapsed_ms = MAX(k_cyc_to_ms_floor32(now - last_cycles), 1U);
+
+	last_cycles = now;
+
+	update_trackers(elapsed_ms);
+	update_forwarder(elapsed_ms);
+	update_scan(elapsed_ms);
+	update_downlink();
+
+	k_work_reschedule_for_queue(&stats_wq, &stats_print,
+				    K_MSEC(CONFIG_SLIMEVR_STATS_INTERVAL_MS));
+}
+
+void stats_start(connection_map *cm)
+{
+	connections = cm;
+	last_cycles = k_cycle_get_32();
+
+	k_work_queue_start(&stats_wq, stats_stack,
+			   K_THREAD_STACK_SIZEOF(stats_stack),
+			   K_LOWEST_APPLICATION_THREAD_PRIO, NULL);
+	k_thread_name_set(&stats_wq.thread, "stats");
+
+	k_work_init_delayable(&stats_print, print_stats);
+	k_work_reschedule_for_queue(&stats_wq, &stats_print,
+				    K_MSEC(CONFIG_SLIMEVR_STATS_INTERVAL_MS));
+}
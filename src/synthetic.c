@@ -0,0 +1,116 @@
+/* synthetic.c - Generated trackers in place of the Bluetooth central */
+
+/*
+ * Built instead of main.c with CONFIG_SLIMEVR_SYNTHETIC, typically for
+ * native_sim. Every tracker slot is marked streaming right away and a
+ * generator thread feeds rotation packets into tracker_rx(), the path real
+ * notifications take, round robin so they arrive spread out like they
+ * do over several links. Everything from there on, forwarding, the
+ * server session and the statistics, is the code the receiver runs.
+ *
+ * Payloads longer than a rotation end in [u32 sequence][u32 generation
+ * time in us] so a host receiver can count losses and delays, see
+ * scripts/svr_bench.py.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(synthetic, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <math.h>
+#include <string.h>
+
+#include "echo_server.h"
+#include "ram_budget.h"
+#include "slimevr_client.h"
+#include "slimevr_proto.h"
+#include "stats.h"
+#include "tracker_rx.h"
+
+#define SYN_TRACKERS CONFIG_SLIMEVR_SYNTHETIC_TRACKERS
+#define SYN_PAYLOAD CONFIG_SLIMEVR_SYNTHETIC_PAYLOAD
+#define SYN_MARKER_LEN 8
+/* One sample of one tracker per tick */
+#define SYN_TICK_US (USEC_PER_SEC / (CONFIG_SLIMEVR_SYNTHETIC_RATE_HZ * SYN_TRACKERS))
+
+BUILD_ASSERT(SYN_TICK_US > 0, "Synthetic sample rate too high");
+
+CONNECTION_MAP_INIT(connections, SYN_TRACKERS)
+
+RAM_BUDGET_DEFINE(connections,
+		  sizeof(connection_entry) + sizeof(connection_rx),
+		  sizeof(connectionsconn_index));
+
+static uint32_t sequence[SYN_TRACKERS];
+
+RAM_BUDGET_DEFINE(synthetic, 0,
+		  sizeof(sequence) + CONFIG_SLIMEVR_SYNTHETIC_STACK_SIZE);
+
+static size_t synthetic_sample(uint8_t tracker, uint8_t *buf)
+{
+	/* Each tracker turns about the vertical axis at its own speed */
+	float angle = (float)sequence[tracker] * 0.01f * (tracker + 1);
+	const float quat[4] = {0.0f, 0.0f, sinf(angle / 2), cosf(angle / 2)};
+	size_t len = svr_encode_rotation(buf, tracker, quat, 3);
+
+	if (SYN_PAYLOAD < len + SYN_MARKER_LEN) {
+		return len;
+	}
+
+	memset(&buf[len], 0, SYN_PAYLOAD - len);
+	sys_put_be32(sequence[tracker], &buf[len]);
+	sys_put_be32((uint32_t)k_ticks_to_us_floor64(k_uptime_ticks()),
+		     &buf[len + 4]);
+
+	return SYN_PAYLOAD;
+}
+
+static void synthetic_thread(void)
+{
+	uint8_t buf[MAX(SYN_PAYLOAD, SVR_ROTATION_LEN)];
+	int64_t next = k_uptime_ticks();
+	uint8_t tracker = 0;
+
+	LOG_INF("%d synthetic trackers at %d Hz, %d byte payloads", SYN_TRACKERS,
+		CONFIG_SLIMEVR_SYNTHETIC_RATE_HZ, MAX(SYN_PAYLOAD, SVR_ROTATION_LEN));
+
+	while (true) {
+		size_t len = synthetic_sample(tracker, buf);
+
+		tracker_rx(&connections, tracker, buf, len, k_cycle_get_32());
+		sequence[tracker]++;
+		tracker = (tracker + 1) % SYN_TRACKERS;
+
+		/* Absolute schedule, a late tick does not shift the ones after */
+		next += k_us_to_ticks_near64(SYN_TICK_US);
+		k_sleep(K_TIMEOUT_ABS_TICKS(next));
+	}
+}
+
+/* Plays the Bluetooth RX thread, started once the slots are set up */
+K_THREAD_DEFINE(synthetic_thread_id, CONFIG_SLIMEVR_SYNTHETIC_STACK_SIZE,
+		synthetic_thread, NULL, NULL, NULL, K_PRIO_COOP(8), 0,
+		SYS_FOREVER_MS);
+
+int main(void)
+{
+	for (int i = 0; i < SYN_TRACKERS; i++) {
+		connection_entry *entry = &connections.entry[i];
+
+		entry->addr.type = BT_ADDR_LE_RANDOM;
+		entry->addr.a.val[0] = i;
+		entry->addr.a.val[5] = 0xc0;
+		cm_set_state(entry, CM_STATE_STREAMING);
+		svr_client_tracker_online(i, true);
+	}
+
+	ram_budget_report();
+	stats_start(&connections);
+	k_thread_start(synthetic_thread_id);
+
+	/* Runs the network side until it quits */
+	start_echo_server();
+
+	return 0;
+}
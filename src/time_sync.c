@@ -0,0 +1,254 @@
+/* time_sync.c - Tracker clock offset and drift estimation */
+
+/*
+ * A request carries the receiver time t1 it was queued at, the reply the
+ * tracker time t2 it was answered at and arrives at t3. Assuming both
+ * legs take as long, t2 - (t1 + t3) / 2 is the offset of the tracker
+ * clock. Queueing and connection events make the legs anything but
+ * symmetric, so only the exchange with the shortest round trip of every
+ * CONFIG_SLIMEVR_TIME_SYNC_WINDOW is used. Successive offsets give the
+ * drift, which is smoothed over several windows.
+ *
+ * All times are microseconds of the respective clock in 32 bits and are
+ * only ever compared by their wrapping difference.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(time_sync, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <errno.h>
+#include <string.h>
+
+#include "gatt_tx.h"
+#include "ram_budget.h"
+#include "slimevr_proto.h"
+#include "time_sync.h"
+
+#define SYNC_TRACKERS CONFIG_SLIMEVR_MAX_TRACKERS
+/* Drift smoothing, each window moves the estimate by 1/2^shift */
+#define SYNC_DRIFT_SHIFT 2
+#define SYNC_DRIFT_MAX_PPB 500000
+/* Larger offset changes between two windows restart the clock model */
+#define SYNC_STEP_MAX_US CONFIG_SLIMEVR_TIME_SYNC_STEP_US
+
+struct sync_state {
+	/* Last request sent, only its reply is accepted */
+	uint8_t seq;
+	/* Best exchange of the current window */
+	uint8_t samples;
+	uint32_t best_rtt;
+	int32_t best_offset;
+	uint32_t best_mid;
+	/* Clock model: tracker = receiver + offset + drift * (receiver - ref) */
+	bool synced;
+	bool drift_valid;
+	int32_t offset;
+	int32_t drift_ppb;
+	uint32_t ref_us;
+	uint32_t rtt;
+	uint32_t exchanges;
+	uint32_t rejected;
+};
+
+static struct sync_state state[SYNC_TRACKERS];
+
+static struct k_spinlock lock;
+static connection_map *connections;
+
+RAM_BUDGET_DEFINE(time_sync, sizeof(struct sync_state), 0);
+
+static void sync_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(sync_work, sync_handler);
+
+static uint32_t now_us(void)
+{
+	return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static uint32_t to_receiver(const struct sync_state *s, uint32_t tracker_us)
+{
+	uint32_t local = tracker_us - s->offset;
+	int32_t since = local - s->ref_us;
+
+	return local - (int32_t)((int64_t)since * s->drift_ppb / 1000000000);
+}
+
+/* Called at the end of a window with its best exchange */
+static void sync_update(uint8_t tracker, struct sync_state *s)
+{
+	if (s->synced) {
+		int32_t elapsed = s->best_mid - s->ref_us;
+		int32_t step = s->best_offset - s->offset;
+		int64_t drift;
+
+		if (step > SYNC_STEP_MAX_US || step < -SYNC_STEP_MAX_US) {
+			/* Not drift, the tracker rebooted or its clock was set */
+			LOG_INF("Tracker %d resynced, offset stepped %d us", tracker,
+				step);
+			s->drift_ppb = 0;
+			s->drift_valid = false;
+		} else if (elapsed > 0) {
+			drift = (int64_t)step * 1000000000 / elapsed;
+			drift = CLAMP(drift, -SYNC_DRIFT_MAX_PPB, SYNC_DRIFT_MAX_PPB);
+
+			if (s->drift_valid) {
+				s->drift_ppb += (drift - s->drift_ppb) >> SYNC_DRIFT_SHIFT;
+			} else {
+				s->drift_ppb = drift;
+				s->drift_valid = true;
+			}
+		}
+	} else {
+		LOG_INF("Tracker %d synced, offset %d us, rtt %u us", tracker,
+			s->best_offset, s->best_rtt);
+	}
+
+	s->offset = s->best_offset;
+	s->ref_us = s->best_mid;
+	s->rtt = s->best_rtt;
+	s->synced = true;
+	s->samples = 0;
+}
+
+bool time_sync_handle(uint8_t tracker, const uint8_t *data, uint16_t length)
+{
+	uint32_t t3 = now_us();
+	struct sync_state *s;
+	k_spinlock_key_t key;
+	uint32_t t1, t2, rtt;
+
+	if (length < SVR_TYPE_LEN ||
+	    sys_get_be32(data) != SVR_PACKET_TIME_SYNC) {
+		return false;
+	}
+
+	if (tracker >= SYNC_TRACKERS || length < SVR_TIME_SYNC_REPLY_LEN) {
+		return true;
+	}
+
+	t1 = sys_get_be32(&data[SVR_HEADER_LEN + 1]);
+	t2 = sys_get_be32(&data[SVR_HEADER_LEN + 5]);
+	rtt = t3 - t1;
+	s = &state[tracker];
+
+	key = k_spin_lock(&lock);
+
+	if (data[SVR_HEADER_LEN] != s->seq ||
+	    rtt > CONFIG_SLIMEVR_TIME_SYNC_MAX_RTT_MS * USEC_PER_MSEC) {
+		s->rejected++;
+		k_spin_unlock(&lock, key);
+		return true;
+	}
+
+	s->exchanges++;
+
+	if (s->samples == 0 || rtt < s->best_rtt) {
+		s->best_rtt = rtt;
+		s->best_mid = t1 + rtt / 2;
+		s->best_offset = t2 - s->best_mid;
+	}
+
+	if (++s->samples == CONFIG_SLIMEVR_TIME_SYNC_WINDOW) {
+		sync_update(tracker, s);
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return true;
+}
+
+uint16_t time_sync_stamp(uint8_t tracker, const uint8_t *data,
+			 uint16_t length, uint8_t *buf)
+{
+	uint32_t capture = now_us();
+	k_spinlock_key_t key;
+
+	if ((length != SVR_ROTATION_LEN && length != SVR_ROTATION_TIMED_LEN) ||
+	    sys_get_be32(data) != SVR_PACKET_ROTATION_DATA) {
+		return 0;
+	}
+
+	if (length == SVR_ROTATION_TIMED_LEN && tracker < SYNC_TRACKERS) {
+		key = k_spin_lock(&lock);
+		if (state[tracker].synced) {
+			capture = to_receiver(&state[tracker],
+					      sys_get_be32(&data[SVR_ROTATION_LEN]));
+		}
+		k_spin_unlock(&lock, key);
+	}
+
+	memcpy(buf, data, SVR_ROTATION_LEN);
+	sys_put_be32(capture, &buf[SVR_ROTATION_LEN]);
+
+	return SVR_ROTATION_TIMED_LEN;
+}
+
+static void sync_handler(struct k_work *work)
+{
+	uint8_t req[SVR_TIME_SYNC_LEN];
+	int count = MIN(connections->size, SYNC_TRACKERS);
+
+	for (int i = 0; i < count; i++) {
+		k_spinlock_key_t key;
+		uint8_t seq;
+
+		if (connections->entry[i].state != CM_STATE_STREAMING) {
+			continue;
+		}
+
+		key = k_spin_lock(&lock);
+		seq = ++state[i].seq;
+		k_spin_unlock(&lock, key);
+
+		/* Queued at t1, the queueing delay only adds to the round trip */
+		(void)gatt_tx_send(i, req, svr_encode_time_sync(req, seq, now_us()));
+	}
+
+	k_work_reschedule(&sync_work, K_MSEC(CONFIG_SLIMEVR_TIME_SYNC_PERIOD_MS));
+}
+
+void time_sync_reset(uint8_t tracker)
+{
+	k_spinlock_key_t key;
+
+	if (tracker >= SYNC_TRACKERS) {
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+	memset(&state[tracker], 0, sizeof(state[tracker]));
+	k_spin_unlock(&lock, key);
+}
+
+int time_sync_get(uint8_t tracker, struct time_sync_info *info)
+{
+	struct sync_state *s;
+	k_spinlock_key_t key;
+
+	if (tracker >= SYNC_TRACKERS) {
+		return -EINVAL;
+	}
+
+	s = &state[tracker];
+
+	key = k_spin_lock(&lock);
+	info->synced = s->synced;
+	info->offset_us = s->offset;
+	info->drift_ppb = s->drift_ppb;
+	info->rtt_us = s->rtt;
+	info->exchanges = s->exchanges;
+	info->rejected = s->rejected;
+	k_spin_unlock(&lock, key);
+
+	return 0;
+}
+
+void time_sync_start(connection_map *cm)
+{
+	connections = cm;
+	k_work_reschedule(&sync_work, K_MSEC(CONFIG_SLIMEVR_TIME_SYNC_PERIOD_MS));
+}
@@ -0,0 +1,140 @@
+/* tracker_registry.c - Persistent list of known trackers */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(tracker_registry, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "ram_budget.h"
+#include "tracker_registry.h"
+
+#define REGISTRY_KEY "svr_reg"
+
+static bt_addr_le_t known[CONFIG_SLIMEVR_REGISTRY_SIZE];
+static int known_count;
+
+/* CONFIG_SLIMEVR_REGISTRY_SIZE defaults to the tracker count */
+RAM_BUDGET_DEFINE(registry, 0, sizeof(known));
+
+static K_MUTEX_DEFINE(registry_lock);
+
+/* Entries added in RAM and not yet written to flash */
+static ATOMIC_DEFINE(dirty, CONFIG_SLIMEVR_REGISTRY_SIZE);
+
+static void store_handler(struct k_work *work);
+
+static K_WORK_DEFINE(store_work, store_handler);
+
+static int find(const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < known_count; i++) {
+		if (bt_addr_le_eq(addr, &known[i])) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/* Writes flash on the system work queue, never on the BT RX thread */
+static void store_handler(struct k_work *work)
+{
+	for (int i = 0; i < ARRAY_SIZE(known); i++) {
+		char key[sizeof(REGISTRY_KEY "/") + 3];
+		bt_addr_le_t addr;
+		int err;
+
+		if (!atomic_test_and_clear_bit(dirty, i)) {
+			continue;
+		}
+
+		k_mutex_lock(&registry_lock, K_FOREVER);
+		bt_addr_le_copy(&addr, &known[i]);
+		k_mutex_unlock(&registry_lock);
+
+		snprintf(key, sizeof(key), REGISTRY_KEY "/%d", i);
+		err = settings_save_one(key, &addr, sizeof(addr));
+		if (err) {
+			LOG_WRN("Failed to store %s (err %d)", key, err);
+		}
+	}
+}
+
+int registry_add(const bt_addr_le_t *addr)
+{
+	char addr_str[BT_ADDR_LE_STR_LEN];
+	int index;
+
+	k_mutex_lock(&registry_lock, K_FOREVER);
+
+	if (find(addr) >= 0) {
+		k_mutex_unlock(&registry_lock);
+		return 0;
+	}
+
+	if (known_count >= ARRAY_SIZE(known)) {
+		k_mutex_unlock(&registry_lock);
+		return -ENOMEM;
+	}
+
+	index = known_count++;
+	bt_addr_le_copy(&known[index], addr);
+
+	k_mutex_unlock(&registry_lock);
+
+	bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
+	LOG_INF("New tracker %s", addr_str);
+
+	atomic_set_bit(dirty, index);
+	k_work_submit(&store_work);
+
+	return 0;
+}
+
+int registry_count(void)
+{
+	return known_count;
+}
+
+int registry_get_all(bt_addr_le_t *out, int max)
+{
+	int count;
+
+	k_mutex_lock(&registry_lock, K_FOREVER);
+
+	count = MIN(max, known_count);
+	memcpy(out, known, count * sizeof(*out));
+
+	k_mutex_unlock(&registry_lock);
+
+	return count;
+}
+
+static int registry_set(const char *name, size_t len, settings_read_cb read_cb,
+			void *cb_arg)
+{
+	int index = atoi(name);
+	ssize_t ret;
+
+	if (index < 0 || index >= ARRAY_SIZE(known) || len != sizeof(known[0])) {
+		return -EINVAL;
+	}
+
+	ret = read_cb(cb_arg, &known[index], sizeof(known[index]));
+	if (ret < 0) {
+		return ret;
+	}
+
+	known_count = MAX(known_count, index + 1);
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(tracker_registry, REGISTRY_KEY, NULL,
+			       registry_set, NULL, NULL);
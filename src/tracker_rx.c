@@ -0,0 +1,32 @@
+/* tracker_rx.c - Notification data path shared by every tracker source */
+
+#include <zephyr/kernel.h>
+
+#include "forwarder.h"
+#include "slimevr_proto.h"
+#include "stats.h"
+#include "time_sync.h"
+#include "tracker_rx.h"
+
+void tracker_rx(connection_map *cm, int index, const void *data,
+		uint16_t length, uint32_t now)
+{
+	cm_count_rx(cm, index, length, now, stats_gap_cycles());
+
+	if (IS_ENABLED(CONFIG_SLIMEVR_TIME_SYNC)) {
+		uint8_t timed[SVR_ROTATION_TIMED_LEN];
+		uint16_t timed_len;
+
+		if (time_sync_handle(index, data, length)) {
+			return;
+		}
+
+		timed_len = time_sync_stamp(index, data, length, timed);
+		if (timed_len != 0) {
+			fwd_submit(index, timed, timed_len, now);
+			return;
+		}
+	}
+
+	fwd_submit(index, data, length, now);
+}
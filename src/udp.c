@@ -18,20 +18,32 @@ LOG_MODULE_DECLARE(net_echo_server_sample, LOG_LEVEL_DBG);
 #include <zephyr/net/tls_credentials.h>
 
 #include "common.h"
+#include "forwarder.h"
+#include "slimevr_client.h"
 // #include "certificate.h"
 
-static void process_udp4(void);
-static void process_udp6(void);
+static void process_udp_loop(void);
 
-K_THREAD_DEFINE(udp4_thread_id, STACK_SIZE,
-		process_udp4, NULL, NULL, NULL,
+K_THREAD_DEFINE(udp_thread_id, CONFIG_SLIMEVR_UDP_STACK_SIZE,
+		process_udp_loop, NULL, NULL, NULL,
 		THREAD_PRIORITY,
 		IS_ENABLED(CONFIG_USERSPACE) ? K_USER : 0, -1);
 
-K_THREAD_DEFINE(udp6_thread_id, STACK_SIZE,
-		process_udp6, NULL, NULL, NULL,
-		THREAD_PRIORITY,
-		IS_ENABLED(CONFIG_USERSPACE) ? K_USER : 0, -1);
+/* Every socket served by the loop, one per enabled address family */
+static struct data *const udp_sockets[] = {
+#if defined(CONFIG_NET_IPV4)
+	&conf.ipv4,
+#endif
+#if defined(CONFIG_NET_IPV6)
+	&conf.ipv6,
+#endif
+};
+
+BUILD_ASSERT(ARRAY_SIZE(udp_sockets) <= CONFIG_NET_SOCKETS_POLL_MAX,
+	     "CONFIG_NET_SOCKETS_POLL_MAX too small for the UDP sockets");
+
+/* Only the loop thread reads, so all sockets share one buffer */
+static APP_BMEM uint8_t recv_buffer[CONFIG_SLIMEVR_UDP_RECV_BUFFER_SIZE];
 
 static int start_udp_proto(struct data *data, struct sockaddr *bind_addr,
 			   socklen_t bind_addrlen)
@@ -91,7 +103,7 @@ static int start_udp_proto(struct data *data, struct sockaddr *bind_addr,
 		 * IPv4 using another socket
 		 */
 		optval = 1;
-		(void)setsockopt(data->tcp.sock, IPPROTO_IPV6, IPV6_V6ONLY,
+		(void)setsockopt(data->udp.sock, IPPROTO_IPV6, IPV6_V6ONLY,
 				 &optval, sizeof(optval));
 	}
 
@@ -107,54 +119,44 @@ static int start_udp_proto(struct data *data, struct sockaddr *bind_addr,
 
 static int process_udp(struct data *data)
 {
-	int ret = 0;
 	int received;
 	struct sockaddr client_addr;
 	socklen_t client_addr_len;
 
-	NET_INFO("Waiting for UDP packets on port %d (%s)...",
-		 MY_PORT, data->proto);
-
-	do {
-		client_addr_len = sizeof(client_addr);
-		received = recvfrom(data->udp.sock, data->udp.recv_buffer,
-				    sizeof(data->udp.recv_buffer), 0,
-				    &client_addr, &client_addr_len);
+	client_addr_len = sizeof(client_addr);
+	received = recvfrom(data->udp.sock, recv_buffer, sizeof(recv_buffer),
+			    MSG_DONTWAIT, &client_addr, &client_addr_len);
 
-		if (received < 0) {
-			/* Socket error */
-			NET_ERR("UDP (%s): Connection error %d", data->proto,
-				errno);
-			ret = -errno;
-			break;
-		} else if (received) {
-			atomic_add(&data->udp.bytes_received, received);
+	if (received < 0) {
+		if (errno == EAGAIN) {
+			return 0;
 		}
 
-		ret = sendto(data->udp.sock, data->udp.recv_buffer, received, 0,
-			     &client_addr, client_addr_len);
-		if (ret < 0) {
-			NET_ERR("UDP (%s): Failed to send %d", data->proto,
-				errno);
-			ret = -errno;
-			break;
-		}
+		/* Socket error */
+		NET_ERR("UDP (%s): Connection error %d", data->proto, errno);
+		return -errno;
+	} else if (received) {
+		atomic_add(&data->udp.bytes_received, received);
+	}
 
-		if (++data->udp.counter % 1000 == 0U) {
-			NET_INFO("%s UDP: Sent %u packets", data->proto,
-				 data->udp.counter);
-		}
+	svr_client_recv(data->udp.sock, recv_buffer, received,
+			&client_addr, client_addr_len);
 
-		NET_DBG("UDP (%s): Received and replied with %d bytes",
-			data->proto, received);
-	} while (true);
+	if (++data->udp.counter % 1000 == 0U) {
+		NET_INFO("%s UDP: Received %u packets", data->proto,
+			 data->udp.counter);
+	}
 
-	return ret;
+	NET_DBG("UDP (%s): Received %d bytes", data->proto, received);
+
+	return 0;
 }
 
-static void process_udp4(void)
+static int start_udp_sockets(void)
 {
 	int ret;
+
+#if defined(CONFIG_NET_IPV4)
 	struct sockaddr_in addr4;
 
 	(void)memset(&addr4, 0, sizeof(addr4));
@@ -164,21 +166,15 @@ static void process_udp4(void)
 	ret = start_udp_proto(&conf.ipv4, (struct sockaddr *)&addr4,
 			      sizeof(addr4));
 	if (ret < 0) {
-		quit();
-		return;
+		return ret;
 	}
 
-	while (ret == 0) {
-		ret = process_udp(&conf.ipv4);
-		if (ret < 0) {
-			quit();
-		}
-	}
-}
+	/* Trackers are forwarded and the server session runs on this one */
+	fwd_attach_socket(conf.ipv4.udp.sock);
+	svr_client_attach_socket(conf.ipv4.udp.sock);
+#endif
 
-static void process_udp6(void)
-{
-	int ret;
+#if defined(CONFIG_NET_IPV6)
 	struct sockaddr_in6 addr6;
 
 	(void)memset(&addr6, 0, sizeof(addr6));
@@ -187,17 +183,59 @@ static void process_udp6(void)
 
 	ret = start_udp_proto(&conf.ipv6, (struct sockaddr *)&addr6,
 			      sizeof(addr6));
+	if (ret < 0) {
+		return ret;
+	}
+#endif
+
+	return 0;
+}
+
+static void process_udp_loop(void)
+{
+	struct pollfd fds[ARRAY_SIZE(udp_sockets)];
+	int ret;
+
+	ret = start_udp_sockets();
 	if (ret < 0) {
 		quit();
 		return;
 	}
 
-	while (ret == 0) {
-		ret = process_udp(&conf.ipv6);
+	for (int i = 0; i < ARRAY_SIZE(udp_sockets); i++) {
+		fds[i].fd = udp_sockets[i]->udp.sock;
+		fds[i].events = POLLIN;
+	}
+
+	NET_INFO("Waiting for UDP packets on port %d...", MY_PORT);
+
+	while (true) {
+		ret = poll(fds, ARRAY_SIZE(fds), -1);
 		if (ret < 0) {
-			quit();
+			NET_ERR("UDP: poll error %d", errno);
+			break;
+		}
+
+		for (int i = 0; i < ARRAY_SIZE(fds); i++) {
+			if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+				NET_ERR("UDP (%s): Socket error 0x%x",
+					udp_sockets[i]->proto, fds[i].revents);
+				ret = -EIO;
+			} else if (fds[i].revents & POLLIN) {
+				ret = process_udp(udp_sockets[i]);
+			}
+
+			if (ret < 0) {
+				break;
+			}
+		}
+
+		if (ret < 0) {
+			break;
 		}
 	}
+
+	quit();
 }
 
 static void print_stats(struct k_work *work)
@@ -223,47 +261,35 @@ static void print_stats(struct k_work *work)
 
 void start_udp(void)
 {
-	if (IS_ENABLED(CONFIG_NET_IPV6)) {
-#if defined(CONFIG_USERSPACE)
-		k_mem_domain_add_thread(&app_domain, udp6_thread_id);
-#endif
+	for (int i = 0; i < ARRAY_SIZE(udp_sockets); i++) {
+		struct data *data = udp_sockets[i];
 
-		k_work_init_delayable(&conf.ipv6.udp.stats_print, print_stats);
-		k_thread_name_set(udp6_thread_id, "udp6");
-		k_thread_start(udp6_thread_id);
-		k_work_reschedule(&conf.ipv6.udp.stats_print,
+		k_work_init_delayable(&data->udp.stats_print, print_stats);
+		k_work_reschedule(&data->udp.stats_print,
 				  K_SECONDS(STATS_TIMER));
 	}
 
-	if (IS_ENABLED(CONFIG_NET_IPV4)) {
 #if defined(CONFIG_USERSPACE)
-		k_mem_domain_add_thread(&app_domain, udp4_thread_id);
+	k_mem_domain_add_thread(&app_domain, udp_thread_id);
 #endif
 
-		k_work_init_delayable(&conf.ipv4.udp.stats_print, print_stats);
-		k_thread_name_set(udp4_thread_id, "udp4");
-		k_thread_start(udp4_thread_id);
-		k_work_reschedule(&conf.ipv4.udp.stats_print,
-				  K_SECONDS(STATS_TIMER));
-	}
+	k_thread_name_set(udp_thread_id, "udp");
+	k_thread_start(udp_thread_id);
 }
 
 void stop_udp(void)
 {
 	/* Not very graceful way to close a thread, but as we may be blocked
-	 * in recvfrom call it seems to be necessary
+	 * in poll call it seems to be necessary
 	 */
-	if (IS_ENABLED(CONFIG_NET_IPV6)) {
-		k_thread_abort(udp6_thread_id);
-		if (conf.ipv6.udp.sock >= 0) {
-			(void)close(conf.ipv6.udp.sock);
-		}
-	}
-
-	if (IS_ENABLED(CONFIG_NET_IPV4)) {
-		k_thread_abort(udp4_thread_id);
-		if (conf.ipv4.udp.sock >= 0) {
-			(void)close(conf.ipv4.udp.sock);
+	svr_client_detach_socket();
+	fwd_detach_socket();
+	k_thread_abort(udp_thread_id);
+
+	for (int i = 0; i < ARRAY_SIZE(udp_sockets); i++) {
+		if (udp_sockets[i]->udp.sock >= 0) {
+			(void)close(udp_sockets[i]->udp.sock);
+			udp_sockets[i]->udp.sock = -1;
 		}
 	}
-}
\ No newline at end of file
+}
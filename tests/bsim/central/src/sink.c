@@ -0,0 +1,127 @@
+/* sink.c - Counts forwarded samples in place of the network half */
+
+/*
+ * The BabbleSim build has no USB or network, tracker_rx() still runs as
+ * on the receiver and hands every sample to fwd_submit(), which lands
+ * here. Simulated trackers end each rotation in [u32 sequence][u32 send
+ * time in us] like the synthetic ones, so losses are counted per tracker
+ * whichever slot it got.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <errno.h>
+#include <string.h>
+
+#include "forwarder.h"
+#include "slimevr_client.h"
+#include "slimevr_proto.h"
+#include "stats.h"
+#include "sink.h"
+
+/* Written by the BT RX thread only, read by the test tick */
+static struct sink_tracker trackers[SINK_IDS];
+static bool seen[SINK_IDS];
+static uint32_t streaming_ms[SINK_IDS];
+static int streaming;
+static uint32_t total;
+static uint32_t rate;
+
+extern connection_map connections;
+
+void sink_set_rate(uint32_t rate_hz)
+{
+	rate = rate_hz;
+}
+
+int fwd_submit(uint8_t tracker, const void *data, uint16_t length,
+	       uint32_t stamp)
+{
+	const uint8_t *buf = data;
+	struct sink_tracker *t;
+	uint8_t id;
+	uint32_t seq;
+
+	ARG_UNUSED(tracker);
+	ARG_UNUSED(stamp);
+
+	if (length < SVR_ROTATION_LEN + 8 ||
+	    sys_get_be32(buf) != SVR_PACKET_ROTATION_DATA) {
+		return 0;
+	}
+
+	id = buf[SVR_HEADER_LEN];
+	if (id >= SINK_IDS) {
+		return -EINVAL;
+	}
+
+	t = &trackers[id];
+	seq = sys_get_be32(&buf[SVR_ROTATION_LEN]);
+
+	if (!seen[id]) {
+		seen[id] = true;
+		t->first_ms = k_uptime_get_32();
+		streaming_ms[streaming++] = t->first_ms;
+	} else if (seq > t->next_seq) {
+		t->lost += seq - t->next_seq;
+	}
+
+	t->last_ms = k_uptime_get_32();
+	t->next_seq = seq + 1;
+	t->samples++;
+	total++;
+
+	return 0;
+}
+
+bool sink_get(uint8_t id, struct sink_tracker *out)
+{
+	if (id >= SINK_IDS || !seen[id]) {
+		return false;
+	}
+
+	*out = trackers[id];
+
+	return true;
+}
+
+uint32_t sink_total(void)
+{
+	return total;
+}
+
+uint32_t sink_all_streaming_ms(int count)
+{
+	if (count <= 0 || count > streaming) {
+		return 0;
+	}
+
+	return streaming_ms[count - 1];
+}
+
+void svr_client_tracker_online(uint8_t tracker, bool online)
+{
+	ARG_UNUSED(tracker);
+	ARG_UNUSED(online);
+}
+
+void stats_start(connection_map *cm)
+{
+	ARG_UNUSED(cm);
+}
+
+/* Every streaming link is assumed to run at the nominal rate, which is
+ * what the statistics would measure in steady state
+ */
+int stats_get_tracker(uint8_t tracker, struct tracker_rates *out)
+{
+	if (tracker >= connections.size) {
+		return -EINVAL;
+	}
+
+	memset(out, 0, sizeof(*out));
+	out->active = connections.entry[tracker].state == CM_STATE_STREAMING;
+	out->packets_per_sec = out->active ? rate : 0;
+
+	return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef SINK_H_
+#define SINK_H_
+
+#include <zephyr/types.h>
+
+/* Trackers are told apart by the sensor id of their rotations, 1..N */
+#define SINK_IDS (CONFIG_SLIMEVR_MAX_TRACKERS + 1)
+
+struct sink_tracker {
+	uint32_t samples;
+	/* Sequence numbers skipped, the tracker numbers every sample */
+	uint32_t lost;
+	uint32_t next_seq;
+	/* k_uptime_get_32() of the first and the latest sample */
+	uint32_t first_ms;
+	uint32_t last_ms;
+};
+
+/* Nominal rate the trackers send at, reported as their measured rate */
+void sink_set_rate(uint32_t rate_hz);
+
+/* Copies the counters of sensor id, false if it never sent a sample */
+bool sink_get(uint8_t id, struct sink_tracker *out);
+
+/* Samples of every tracker so far */
+uint32_t sink_total(void);
+
+/* k_uptime_get_32() when the count-th distinct tracker first sent, 0 if
+ * fewer ever did */
+uint32_t sink_all_streaming_ms(int count);
+
+#endif
@@ -0,0 +1,183 @@
+/* test_central.c - Pass/fail checks on the receiver in BabbleSim */
+
+/*
+ * The receiver's own main() runs unchanged, this only watches what
+ * reaches the sink. Arguments, as key=value after -argstest:
+ *
+ *   trackers   simulated trackers in the simulation
+ *   rate       samples per second each of them sends
+ *   bringup_s  all trackers must be streaming by then
+ *   end_s      the delivery ratio is checked then, over bringup_s..end_s
+ *   min_ratio  percentage of the sent samples that must arrive
+ *
+ * Every tracker must also still be streaming at end_s, after any link
+ * drops.
+ */
+
+#include <zephyr/kernel.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bs_types.h"
+#include "bs_tracing.h"
+#include "bstests.h"
+
+#include "sink.h"
+
+extern enum bst_result_t bst_result;
+
+#define FAIL(...)					\
+	do {						\
+		bst_result = Failed;			\
+		bs_trace_error_time_line(__VA_ARGS__);	\
+	} while (0)
+
+#define PASS(...)					\
+	do {						\
+		bst_result = Passed;			\
+		bs_trace_info_time(1, __VA_ARGS__);	\
+	} while (0)
+
+static uint32_t trackers = 1;
+static uint32_t rate = 100;
+static uint32_t bringup_s = 10;
+static uint32_t end_s = 30;
+static uint32_t min_ratio = 95;
+
+static uint32_t window_total;
+static bool brought_up;
+
+static void test_args(int argc, char *argv[])
+{
+	static const struct {
+		const char *key;
+		uint32_t *value;
+	} keys[] = {
+		{"trackers=", &trackers},
+		{"rate=", &rate},
+		{"bringup_s=", &bringup_s},
+		{"end_s=", &end_s},
+		{"min_ratio=", &min_ratio},
+	};
+
+	for (int i = 0; i < argc; i++) {
+		int k;
+
+		for (k = 0; k < ARRAY_SIZE(keys); k++) {
+			size_t len = strlen(keys[k].key);
+
+			if (strncmp(argv[i], keys[k].key, len) == 0) {
+				*keys[k].value = strtoul(&argv[i][len], NULL, 0);
+				break;
+			}
+		}
+
+		if (k == ARRAY_SIZE(keys)) {
+			bs_trace_error_line("Unknown argument %s\n", argv[i]);
+		}
+	}
+
+	if (trackers == 0 || trackers >= SINK_IDS || end_s <= bringup_s) {
+		bs_trace_error_line("Bad arguments, %u trackers from %u to %u s\n",
+				    trackers, bringup_s, end_s);
+	}
+}
+
+static void test_post_init(void)
+{
+	sink_set_rate(rate);
+	bst_result = In_progress;
+	bst_ticker_set_next_tick_absolute(bringup_s * 1000000ULL);
+}
+
+static void check_bringup(void)
+{
+	uint32_t all_ms = sink_all_streaming_ms(trackers);
+
+	if (all_ms == 0) {
+		FAIL("Not all %u trackers streaming after %u s\n", trackers,
+		     bringup_s);
+		return;
+	}
+
+	bs_trace_info_time(1, "All %u trackers streaming after %u ms\n",
+			   trackers, all_ms);
+	window_total = sink_total();
+	brought_up = true;
+	bst_ticker_set_next_tick_absolute(end_s * 1000000ULL);
+}
+
+/* now_ms is simulated time, which the uptime of the image follows */
+static void check_delivery(uint32_t now_ms)
+{
+	uint64_t expected = (uint64_t)trackers * rate * (end_s - bringup_s);
+	uint32_t delivered = sink_total() - window_total;
+	bool missing = false;
+
+	for (int id = 1; id <= trackers; id++) {
+		struct sink_tracker t;
+
+		if (!sink_get(id, &t)) {
+			bs_trace_info_time(1, "Tracker %d: no samples\n", id);
+			missing = true;
+			continue;
+		}
+
+		bs_trace_info_time(1, "Tracker %d: %u samples, %u lost, first "
+				   "after %u ms\n", id, t.samples, t.lost,
+				   t.first_ms);
+
+		if (t.last_ms + MSEC_PER_SEC < now_ms) {
+			bs_trace_info_time(1, "Tracker %d: silent for %u ms\n",
+					   id, now_ms - t.last_ms);
+			missing = true;
+		}
+	}
+
+	bs_trace_info_time(1, "%u of %llu samples delivered in %u s\n",
+			   delivered, expected, end_s - bringup_s);
+
+	if (missing) {
+		FAIL("Not every tracker streaming at the end\n");
+	} else if ((uint64_t)delivered * 100 < expected * min_ratio) {
+		FAIL("Delivered %u samples, below %u%% of %llu\n", delivered,
+		     min_ratio, expected);
+	} else {
+		PASS("Central passed\n");
+	}
+}
+
+static void test_tick(bs_time_t HW_device_time)
+{
+	if (bst_result == Failed) {
+		return;
+	}
+
+	if (!brought_up) {
+		check_bringup();
+	} else {
+		check_delivery(HW_device_time / 1000);
+	}
+}
+
+static const struct bst_test_instance test_central[] = {
+	{
+		.test_id = "central",
+		.test_descr = "Receiver Bluetooth half, checks bring-up time "
+			      "and the share of samples delivered",
+		.test_args_f = test_args,
+		.test_post_init_f = test_post_init,
+		.test_tick_f = test_tick,
+	},
+	BSTEST_END_MARKER
+};
+
+static struct bst_test_list *test_central_install(struct bst_test_list *tests)
+{
+	return bst_add_tests(tests, test_central);
+}
+
+bst_test_install_t test_installers[] = {
+	test_central_install,
+	NULL
+};
@@ -0,0 +1,20 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: Apache-2.0
+
+# Builds the receiver and tracker images for nrf52_bsim and installs them
+# in ${BSIM_OUT_PATH}/bin as bs_nrf52_bsim_slimevr_{central,tracker}
+
+set -ue
+
+: "${BSIM_OUT_PATH:?BSIM_OUT_PATH must be defined}"
+: "${ZEPHYR_BASE:?ZEPHYR_BASE must be set to point to the zephyr root directory}"
+
+suite_dir=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+build_dir=${BUILD_DIR:-${suite_dir}/build}
+
+for image in central tracker; do
+	west build -p auto -b nrf52_bsim -d "${build_dir}/${image}" \
+		"${suite_dir}/${image}"
+	cp "${build_dir}/${image}/zephyr/zephyr.exe" \
+		"${BSIM_OUT_PATH}/bin/bs_nrf52_bsim_slimevr_${image}"
+done
@@ -0,0 +1,10 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: Apache-2.0
+
+# Six trackers drop their link every 2 to 6 s for the first 30 s and
+# must be back streaming by then. Samples not sent while a tracker was
+# away count as missing, hence the lower delivery ratio.
+
+source $(dirname "${BASH_SOURCE[0]}")/_scenario.source
+
+run_scenario slimevr_link_drops 6 46 0 "rate=100 bringup_s=10 end_s=45 min_ratio=70" "rate=100 drop_min_ms=2000 drop_max_ms=6000 drop_until_s=30"
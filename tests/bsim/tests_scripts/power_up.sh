@@ -0,0 +1,9 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: Apache-2.0
+
+# Eleven trackers power up in the same instant, as when the receiver
+# is plugged in with every tracker already on
+
+source $(dirname "${BASH_SOURCE[0]}")/_scenario.source
+
+run_scenario slimevr_power_up 11 41 0 "rate=100 bringup_s=15 end_s=40 min_ratio=90" "rate=100"
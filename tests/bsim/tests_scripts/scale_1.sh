@@ -0,0 +1,8 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: Apache-2.0
+
+# One tracker streams 100 Hz rotations, nearly all must arrive
+
+source $(dirname "${BASH_SOURCE[0]}")/_scenario.source
+
+run_scenario slimevr_scale_1 1 31 0 "rate=100 bringup_s=5 end_s=30 min_ratio=95" "rate=100"
@@ -0,0 +1,8 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: Apache-2.0
+
+# Eleven trackers, the receiver maximum, powered up 500 ms apart
+
+source $(dirname "${BASH_SOURCE[0]}")/_scenario.source
+
+run_scenario slimevr_scale_11 11 41 500 "rate=100 bringup_s=15 end_s=40 min_ratio=90" "rate=100"
@@ -0,0 +1,8 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: Apache-2.0
+
+# Six trackers powered up 500 ms apart, at 100 Hz each
+
+source $(dirname "${BASH_SOURCE[0]}")/_scenario.source
+
+run_scenario slimevr_scale_6 6 31 500 "rate=100 bringup_s=10 end_s=30 min_ratio=95" "rate=100"
@@ -0,0 +1,294 @@
+/* main.c - Simulated SlimeVR tracker for the BabbleSim suite */
+
+/*
+ * Advertises the SlimeVR service and, while the receiver is subscribed,
+ * notifies rotations at a fixed rate. Each rotation carries the tracker
+ * id as sensor id and ends in [u32 sequence][u32 send time in us], the
+ * layout of the synthetic trackers, so the central can count losses.
+ * Arguments, as key=value after -argstest:
+ *
+ *   id            sensor id, 1..N and unique in the simulation
+ *   rate          rotations per second
+ *   start_ms      power-up delay, 0 for all trackers at once
+ *   drop_min_ms   with drop_max_ms, drops the link after a random time
+ *   drop_max_ms   in between, again after every reconnect
+ *   drop_until_s  no more drops after this time
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/sys/byteorder.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bs_types.h"
+#include "bs_tracing.h"
+#include "bstests.h"
+
+#include "slimevr_gatt.h"
+#include "slimevr_proto.h"
+
+extern enum bst_result_t bst_result;
+
+#define FAIL(...)					\
+	do {						\
+		bst_result = Failed;			\
+		bs_trace_error_time_line(__VA_ARGS__);	\
+	} while (0)
+
+#define PASS(...)					\
+	do {						\
+		bst_result = Passed;			\
+		bs_trace_info_time(1, __VA_ARGS__);	\
+	} while (0)
+
+#define MARKER_LEN 8
+
+static uint32_t id = 1;
+static uint32_t rate = 100;
+static uint32_t start_ms;
+static uint32_t drop_min_ms;
+static uint32_t drop_max_ms;
+static uint32_t drop_until_s;
+
+static struct bt_conn *tracker_conn;
+static bool subscribed;
+static uint32_t commands;
+static uint32_t random_state;
+
+static const struct bt_data ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA_BYTES(BT_DATA_UUID128_ALL, UUID_SLIME_VR_VAL),
+};
+
+/* The name only fits next to the 128-bit UUID in the scan response */
+static const struct bt_data sd[] = {
+	BT_DATA(BT_DATA_NAME_COMPLETE, CONFIG_BT_DEVICE_NAME,
+		sizeof(CONFIG_BT_DEVICE_NAME) - 1),
+};
+
+static void ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	ARG_UNUSED(attr);
+
+	subscribed = value == BT_GATT_CCC_NOTIFY;
+	if (subscribed && bst_result != Passed) {
+		PASS("Tracker %u subscribed\n", id);
+	}
+}
+
+/* Handshake and server commands, only counted */
+static ssize_t write_chr(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			 const void *buf, uint16_t len, uint16_t offset,
+			 uint8_t flags)
+{
+	ARG_UNUSED(conn);
+	ARG_UNUSED(attr);
+	ARG_UNUSED(buf);
+	ARG_UNUSED(offset);
+	ARG_UNUSED(flags);
+
+	commands++;
+
+	return len;
+}
+
+BT_GATT_SERVICE_DEFINE(slime_svc,
+	BT_GATT_PRIMARY_SERVICE(UUID_SLIME_VR),
+	BT_GATT_CHARACTERISTIC(UUID_SLIME_VR_CHR,
+			       BT_GATT_CHRC_NOTIFY | BT_GATT_CHRC_WRITE |
+			       BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+			       BT_GATT_PERM_WRITE, NULL, write_chr, NULL),
+	BT_GATT_CCC(ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+);
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err) {
+		return;
+	}
+
+	tracker_conn = bt_conn_ref(conn);
+}
+
+/* Connectable advertising resumes on its own once the link is gone */
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	if (conn != tracker_conn) {
+		return;
+	}
+
+	bs_trace_info_time(2, "Tracker %u disconnected (reason 0x%02x)\n", id,
+			   reason);
+	subscribed = false;
+	bt_conn_unref(tracker_conn);
+	tracker_conn = NULL;
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
+
+/* xorshift32, seeded by the id so every run drops links the same way */
+static uint32_t random_next(void)
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+
+	return random_state;
+}
+
+static int64_t next_drop(int64_t now)
+{
+	if (drop_max_ms == 0) {
+		return INT64_MAX;
+	}
+
+	return now + drop_min_ms + random_next() % (drop_max_ms - drop_min_ms + 1);
+}
+
+static size_t sample(uint32_t seq, uint8_t *buf)
+{
+	float angle = (float)seq * 0.01f * id;
+	const float quat[4] = {0.0f, 0.0f, sinf(angle / 2), cosf(angle / 2)};
+	size_t len = svr_encode_rotation(buf, id, quat, 3);
+
+	sys_put_be32(seq, &buf[len]);
+	sys_put_be32((uint32_t)k_ticks_to_us_floor64(k_uptime_ticks()),
+		     &buf[len + 4]);
+
+	return len + MARKER_LEN;
+}
+
+static void test_main(void)
+{
+	uint8_t buf[SVR_ROTATION_LEN + MARKER_LEN];
+	int64_t next;
+	int64_t drop_at = INT64_MAX;
+	uint32_t seq = 0;
+	bool was_streaming = false;
+	int err;
+
+	k_sleep(K_MSEC(start_ms));
+
+	err = bt_enable(NULL);
+	if (err) {
+		FAIL("Bluetooth init failed (err %d)\n", err);
+		return;
+	}
+
+	err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd,
+			      ARRAY_SIZE(sd));
+	if (err) {
+		FAIL("Advertising failed to start (err %d)\n", err);
+		return;
+	}
+
+	next = k_uptime_ticks();
+
+	while (true) {
+		int64_t now = k_uptime_get();
+		struct bt_conn *conn = tracker_conn;
+		bool streaming = subscribed && conn != NULL;
+
+		if (streaming && !was_streaming) {
+			drop_at = next_drop(now);
+		}
+		was_streaming = streaming;
+
+		if (streaming && now >= drop_at &&
+		    now < drop_until_s * (int64_t)MSEC_PER_SEC) {
+			bs_trace_info_time(2, "Tracker %u drops the link\n", id);
+			bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+			drop_at = INT64_MAX;
+		} else if (streaming) {
+			/* A failed notify is a lost sample, seq moves on */
+			bt_gatt_notify(conn, &slime_svc.attrs[1], buf,
+				       sample(seq, buf));
+			seq++;
+		}
+
+		/* Absolute schedule, a late tick does not shift the ones after */
+		next += k_us_to_ticks_near64(USEC_PER_SEC / rate);
+		k_sleep(K_TIMEOUT_ABS_TICKS(next));
+	}
+}
+
+static void test_args(int argc, char *argv[])
+{
+	static const struct {
+		const char *key;
+		uint32_t *value;
+	} keys[] = {
+		{"id=", &id},
+		{"rate=", &rate},
+		{"start_ms=", &start_ms},
+		{"drop_min_ms=", &drop_min_ms},
+		{"drop_max_ms=", &drop_max_ms},
+		{"drop_until_s=", &drop_until_s},
+	};
+
+	for (int i = 0; i < argc; i++) {
+		int k;
+
+		for (k = 0; k < ARRAY_SIZE(keys); k++) {
+			size_t len = strlen(keys[k].key);
+
+			if (strncmp(argv[i], keys[k].key, len) == 0) {
+				*keys[k].value = strtoul(&argv[i][len], NULL, 0);
+				break;
+			}
+		}
+
+		if (k == ARRAY_SIZE(keys)) {
+			bs_trace_error_line("Unknown argument %s\n", argv[i]);
+		}
+	}
+
+	if (id == 0 || id > UINT8_MAX || rate == 0 ||
+	    drop_min_ms > drop_max_ms) {
+		bs_trace_error_line("Bad arguments\n");
+	}
+
+	random_state = id * 2654435761U;
+}
+
+static void test_post_init(void)
+{
+	bst_result = In_progress;
+}
+
+static const struct bst_test_instance test_tracker[] = {
+	{
+		.test_id = "tracker",
+		.test_descr = "SlimeVR tracker streaming rotations, passes once "
+			      "the receiver subscribes",
+		.test_args_f = test_args,
+		.test_post_init_f = test_post_init,
+		.test_main_f = test_main,
+	},
+	BSTEST_END_MARKER
+};
+
+static struct bst_test_list *test_tracker_install(struct bst_test_list *tests)
+{
+	return bst_add_tests(tests, test_tracker);
+}
+
+bst_test_install_t test_installers[] = {
+	test_tracker_install,
+	NULL
+};
+
+int main(void)
+{
+	bst_main();
+
+	return 0;
+}
@@ -0,0 +1,322 @@
+/* main.c - Hot path correctness and cycle counts */
+
+/*
+ * Checks the connection map, the forwarding ring and the protocol
+ * encoders, the plain C pieces every notification goes through, then
+ * times them with k_cycle_get_32(). The cycle counts are printed in the
+ * CSV format of the receiver's "bench" shell command:
+ *
+ *   bench,<name>,<slots>,<iterations>,<total cycles>,<cycles/call>,<ns/call>
+ *
+ * There is no Bluetooth host, the bt_conn objects are fakes the
+ * connection map only ever compares and asks the index of.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+#include "connectionManager.h"
+#include "fwd_ring.h"
+#include "slimevr_proto.h"
+
+#define SLOTS CONFIG_SLIMEVR_MAX_TRACKERS
+#define ITERATIONS 10000U
+
+static uint8_t fake_conn[CONFIG_BT_MAX_CONN];
+
+#define FAKE_CONN(i) ((struct bt_conn *)&fake_conn[i])
+
+/* Stands in for the host, which numbers its connection objects */
+uint8_t bt_conn_index(const struct bt_conn *conn)
+{
+	return (const uint8_t *)conn - fake_conn;
+}
+
+CONNECTION_MAP_INIT(map, SLOTS)
+
+static struct fwd_slot ring_slots[8];
+static struct fwd_ring ring = {
+	.slot = ring_slots,
+	.mask = ARRAY_SIZE(ring_slots) - 1,
+};
+
+static volatile int sink;
+
+static void tracker_addr(int i, bt_addr_le_t *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->type = BT_ADDR_LE_RANDOM;
+	addr->a.val[0] = i;
+	addr->a.val[5] = 0xc0;
+}
+
+/* Every slot bound to the fake connection of the same number */
+static void map_fill(void)
+{
+	for (int i = 0; i < SLOTS; i++) {
+		tracker_addr(i, &map.entry[i].addr);
+		zassert_ok(cm_bind_conn(&map, i, FAKE_CONN(i)));
+	}
+}
+
+static void print_cycles(const char *name, int slots, uint32_t cycles)
+{
+	uint64_t ns = k_cyc_to_ns_floor64(cycles);
+
+	TC_PRINT("bench,%s,%d,%u,%u,%u,%llu\n", name, slots, ITERATIONS, cycles,
+		 cycles / ITERATIONS, (unsigned long long)(ns / ITERATIONS));
+}
+
+static void hotpath_before(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	memset(mapentry, 0, sizeof(mapentry));
+	memset(maprx, 0, sizeof(maprx));
+	memset(mapconn_index, -1, sizeof(mapconn_index));
+
+	memset(ring_slots, 0, sizeof(ring_slots));
+	atomic_set(&ring.head, 0);
+	atomic_set(&ring.tail, 0);
+	ring.dropped_full = 0;
+	ring.high_water = 0;
+}
+
+ZTEST(hotpath, test_conn_lookup)
+{
+	bt_addr_le_t addr;
+
+	map_fill();
+
+	for (int i = 0; i < SLOTS; i++) {
+		zassert_equal(cm_get_index_with_conn(&map, FAKE_CONN(i)), i);
+	}
+
+	tracker_addr(SLOTS - 1, &addr);
+	zassert_equal(cm_get_index_with_addr(&map, &addr), SLOTS - 1);
+
+	addr.a.val[0] = 0xff;
+	zassert_equal(cm_get_index_with_addr(&map, &addr), -1);
+	zassert_equal(cm_get_next_free_object_index(&map), -1);
+
+	zassert_ok(cm_remove_object_with_index(&map, 3));
+	zassert_equal(cm_get_index_with_conn(&map, FAKE_CONN(3)), -1);
+	zassert_equal(cm_get_next_free_object_index(&map), 3);
+	tracker_addr(3, &addr);
+	zassert_equal(cm_get_index_with_addr(&map, &addr), -1);
+
+	/* Neighbours are untouched */
+	zassert_equal(cm_get_index_with_conn(&map, FAKE_CONN(2)), 2);
+	zassert_equal(cm_get_index_with_conn(&map, FAKE_CONN(4)), 4);
+
+	zassert_ok(cm_bind_conn(&map, 3, FAKE_CONN(3)));
+	zassert_equal(cm_get_index_with_conn(&map, FAKE_CONN(3)), 3);
+
+	zassert_equal(cm_bind_conn(&map, SLOTS, FAKE_CONN(0)), -1);
+	zassert_equal(cm_remove_object_with_index(&map, -1), -1);
+}
+
+ZTEST(hotpath, test_count_rx)
+{
+	connection_counters before, after;
+
+	zassert_ok(cm_bind_conn(&map, 0, FAKE_CONN(0)));
+
+	/* The first sample after binding is never a gap */
+	cm_count_rx(&map, 0, SVR_ROTATION_LEN, 1000, 100);
+	cm_count_rx(&map, 0, SVR_ROTATION_LEN, 1050, 100);
+	cm_count_rx(&map, 0, SVR_ROTATION_LEN, 1300, 100);
+
+	cm_read_counters(&map, 0, &after);
+	zassert_equal(after.packets, 3);
+	zassert_equal(after.bytes, 3 * SVR_ROTATION_LEN);
+	zassert_equal(after.gaps, 1);
+	zassert_equal(after.gap_cycles, 250);
+	zassert_equal(after.gap_max_cycles, 250);
+	zassert_equal(after.last_rx, 1300);
+
+	/* Readers only use differences, which survive the counters wrapping */
+	map.rx[0].packets = UINT32_MAX;
+	map.rx[0].bytes = UINT32_MAX - 10;
+	cm_read_counters(&map, 0, &before);
+	cm_count_rx(&map, 0, SVR_ROTATION_LEN, 1310, 100);
+	cm_count_rx(&map, 0, SVR_ROTATION_LEN, 1320, 100);
+	cm_read_counters(&map, 0, &after);
+	zassert_equal(after.packets - before.packets, 2);
+	zassert_equal(after.bytes - before.bytes, 2 * SVR_ROTATION_LEN);
+
+	/* A new link is not a gap of the previous one */
+	zassert_ok(cm_bind_conn(&map, 0, FAKE_CONN(0)));
+	cm_count_rx(&map, 0, SVR_ROTATION_LEN, 5000, 100);
+	cm_read_counters(&map, 0, &after);
+	zassert_equal(after.gaps, 1);
+	zassert_equal(after.last_rx, 5000);
+}
+
+ZTEST(hotpath, test_ring)
+{
+	uint8_t data[SVR_ROTATION_LEN];
+
+	for (int i = 0; i < ARRAY_SIZE(ring_slots); i++) {
+		memset(data, i, sizeof(data));
+		zassert_ok(fwd_ring_put(&ring, i, data, sizeof(data), i));
+	}
+
+	zassert_equal(fwd_ring_put(&ring, 8, data, sizeof(data), 8), -ENOBUFS);
+	zassert_equal(ring.dropped_full, 1);
+	zassert_equal(fwd_ring_used(&ring), ARRAY_SIZE(ring_slots));
+	zassert_equal(ring.high_water, ARRAY_SIZE(ring_slots));
+
+	zassert_equal(fwd_ring_peek(&ring, 0)->tracker, 0);
+	zassert_equal(fwd_ring_peek(&ring, 7)->tracker, 7);
+	zassert_equal(fwd_ring_peek(&ring, 7)->data[0], 7);
+	zassert_equal(fwd_ring_peek(&ring, 7)->len, sizeof(data));
+	zassert_is_null(fwd_ring_peek(&ring, 8));
+
+	fwd_ring_release(&ring, 3);
+	zassert_equal(fwd_ring_used(&ring), 5);
+	zassert_equal(fwd_ring_peek(&ring, 0)->tracker, 3);
+
+	/* The freed slots are reused in order */
+	for (int i = 8; i < 11; i++) {
+		zassert_ok(fwd_ring_put(&ring, i, data, sizeof(data), i));
+	}
+
+	for (int i = 0; i < 8; i++) {
+		zassert_equal(fwd_ring_peek(&ring, i)->tracker, i + 3);
+	}
+
+	/* Head and tail run freely through 2^32 */
+	atomic_set(&ring.head, UINT32_MAX - 2);
+	atomic_set(&ring.tail, UINT32_MAX - 2);
+	zassert_equal(fwd_ring_used(&ring), 0);
+
+	for (int i = 0; i < 5; i++) {
+		zassert_ok(fwd_ring_put(&ring, i, data, sizeof(data), i));
+	}
+
+	zassert_equal(fwd_ring_used(&ring), 5);
+	for (int i = 0; i < 5; i++) {
+		zassert_equal(fwd_ring_peek(&ring, i)->tracker, i);
+	}
+
+	fwd_ring_release(&ring, 5);
+	zassert_equal(fwd_ring_used(&ring), 0);
+	zassert_is_null(fwd_ring_peek(&ring, 0));
+}
+
+ZTEST(hotpath, test_encoding)
+{
+	static const float quat[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	static const uint8_t ids[2] = {1, 2};
+	static const uint32_t ages[2] = {500, 100000};
+	uint8_t pkt[SVR_ROTATION_LEN];
+	uint8_t frame[SVR_FRAME_AGES_LEN(2)];
+	uint8_t *record;
+	uint64_t number;
+	int len;
+
+	zassert_equal(svr_encode_rotation(pkt, 5, quat, 3), SVR_ROTATION_LEN);
+	zassert_equal(sys_get_be32(pkt), SVR_PACKET_ROTATION_DATA);
+	zassert_equal(pkt[SVR_HEADER_LEN], 5);
+	zassert_equal(pkt[SVR_HEADER_LEN + 1], SVR_ROTATION_DATA_NORMAL);
+	zassert_equal(sys_get_be32(&pkt[SVR_HEADER_LEN + 14]), 0x3f800000);
+	zassert_equal(pkt[SVR_ROTATION_LEN - 1], 3);
+
+	number = sys_get_be64(&pkt[SVR_TYPE_LEN]);
+	svr_encode_rotation(pkt, 5, quat, 3);
+	zassert_equal(sys_get_be64(&pkt[SVR_TYPE_LEN]), number + 1);
+
+	/* [len][type] replace the packet number, the sensor id is rewritten */
+	len = svr_bundle_record(7, pkt, sizeof(pkt), &record);
+	zassert_equal(len, SVR_ROTATION_LEN - SVR_HEADER_LEN + SVR_TYPE_LEN +
+		      SVR_RECORD_HDR_LEN);
+	zassert_equal_ptr(record, &pkt[SVR_HEADER_LEN - SVR_TYPE_LEN -
+					 SVR_RECORD_HDR_LEN]);
+	zassert_equal(sys_get_be16(record), len - SVR_RECORD_HDR_LEN);
+	zassert_equal(sys_get_be32(&record[SVR_RECORD_HDR_LEN]),
+		      SVR_PACKET_ROTATION_DATA);
+	zassert_equal(record[SVR_RECORD_HDR_LEN + SVR_TYPE_LEN], 7);
+	zassert_equal(svr_bundle_record(7, pkt, SVR_HEADER_LEN - 1, &record),
+		      -EINVAL);
+
+	zassert_equal(svr_encode_frame_ages(frame, ids, ages, 2), sizeof(frame));
+	zassert_equal(sys_get_be16(frame), sizeof(frame) - SVR_RECORD_HDR_LEN);
+	zassert_equal(sys_get_be32(&frame[2]), SVR_PACKET_FRAME_AGES);
+	zassert_equal(frame[6], 2);
+	zassert_equal(frame[7], 1);
+	zassert_equal(sys_get_be16(&frame[8]), 500);
+	zassert_equal(frame[10], 2);
+	zassert_equal(sys_get_be16(&frame[11]), UINT16_MAX);
+
+	/* A packet for one sensor goes to sensor 0 of its tracker */
+	svr_encode_header(pkt, SVR_PACKET_SET_CONFIG_FLAG);
+	pkt[SVR_HEADER_LEN] = 4;
+	zassert_equal(svr_downlink_sensor(pkt, SVR_HEADER_LEN + 1), 4);
+	zassert_equal(pkt[SVR_HEADER_LEN], 0);
+
+	svr_encode_header(pkt, SVR_PACKET_RECEIVE_VIBRATE);
+	zassert_equal(svr_downlink_sensor(pkt, SVR_HEADER_LEN), SVR_SENSOR_ALL);
+
+	svr_encode_header(pkt, SVR_PACKET_PING_PONG);
+	zassert_equal(svr_downlink_sensor(pkt, SVR_HEADER_LEN), -ENOTSUP);
+}
+
+ZTEST(hotpath, test_cycles)
+{
+	static const float quat[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	uint8_t pkt[SVR_ROTATION_LEN] = {0};
+	bt_addr_le_t last;
+	uint8_t *record;
+	uint32_t start;
+
+	map_fill();
+	tracker_addr(SLOTS - 1, &last);
+
+	start = k_cycle_get_32();
+	for (uint32_t i = 0; i < ITERATIONS; i++) {
+		sink = cm_get_index_with_conn(&map, FAKE_CONN(SLOTS - 1));
+	}
+	print_cycles("cm_get_index_with_conn", SLOTS, k_cycle_get_32() - start);
+
+	start = k_cycle_get_32();
+	for (uint32_t i = 0; i < ITERATIONS; i++) {
+		sink = cm_get_index_with_addr(&map, &last);
+	}
+	print_cycles("cm_get_index_with_addr_last", SLOTS, k_cycle_get_32() - start);
+
+	start = k_cycle_get_32();
+	for (uint32_t i = 0; i < ITERATIONS; i++) {
+		cm_count_rx(&map, 0, SVR_ROTATION_LEN, i, 100);
+	}
+	print_cycles("cm_count_rx", 1, k_cycle_get_32() - start);
+
+	start = k_cycle_get_32();
+	for (uint32_t i = 0; i < ITERATIONS; i++) {
+		(void)fwd_ring_put(&ring, 0, pkt, sizeof(pkt), i);
+		(void)fwd_ring_peek(&ring, 0);
+		fwd_ring_release(&ring, 1);
+	}
+	print_cycles("fwd_ring_put_peek_release", 1, k_cycle_get_32() - start);
+
+	start = k_cycle_get_32();
+	for (uint32_t i = 0; i < ITERATIONS; i++) {
+		sink = svr_encode_rotation(pkt, 0, quat, 3);
+	}
+	print_cycles("svr_encode_rotation", 1, k_cycle_get_32() - start);
+
+	/* The record is built in place, so every call encodes again */
+	start = k_cycle_get_32();
+	for (uint32_t i = 0; i < ITERATIONS; i++) {
+		svr_encode_rotation(pkt, 0, quat, 3);
+		sink = svr_bundle_record(1, pkt, sizeof(pkt), &record);
+	}
+	print_cycles("svr_encode_rotation_bundle_record", 1,
+		     k_cycle_get_32() - start);
+
+	zassert_equal(fwd_ring_used(&ring), 0);
+}
+
+ZTEST_SUITE(hotpath, NULL, NULL, hotpath_before, NULL, NULL);